@@ -16,9 +16,14 @@
 #include <algorithm>
 #include <sys/time.h>
 
+#include "../utils/options.hpp"
+#include "../utils/distance.hpp"
+#include "../utils/tour.hpp"
+#include "../utils/rng.hpp"
+#include "../utils/construct.hpp"
+
 using namespace std;
 
-const int N = 1000;
 const int MAX_SEED = 1000;
 const int MAX_ITER = 10000;
 const float PMATE = 0.95;
@@ -26,12 +31,14 @@ const float PMUTATE = 0.9;
 const int REMAIN = MAX_SEED / 100;
 const int BESTS = 3;
 
-float dist[N][N] = {};	// The distance matrix, use (i-1) instead of i
 int n;
+Rng rng;
 
+/* TourT is a utils/tour.hpp representation, picked with --tour=array|twolevel */
+template<class TourT>
 class DNA {
 	public:
-	vector<int> a;
+	TourT t;
 	int n;
 	double len;
 
@@ -39,32 +46,24 @@ class DNA {
 	}
 
 	DNA(int _n): n(_n) {
-		a.resize(n);
-		for (int i = 0; i < n; ++i) {
-			a[i] = i;
-		}
-		random_shuffle(a.begin(), a.end());
-		for (int i = 0; i < n - 1; ++i) {
-			int k = i + 1;
-			for (int j = i + 2; j < n; ++j) {
-				if (dist[a[i]][a[j]] < dist[a[i]][a[k]]) {
-					k = j;
-				}
-			}
-			swap(a[i + 1], a[k]);
-		}
+		vector<int> a(n);
+		buildTour(&a[0], rng);		// --init, nearest neighbor by default
+		t.init(&a[0], n);
 		calcLen();
 	}
 
-	DNA(const vector<int> &_a): a(_a) {
+	DNA(const vector<int> &a) {
 		n = a.size();
+		t.init(&a[0], n);
 		calcLen();
 	}
 
 	void calcLen() {
 		len = 0.0;
+		int c = 0;
 		for (int i = 0; i < n; ++i) {
-			len += dist[a[i]][a[(i + 1) % n]];
+			len += getDist(c, t.next(c));
+			c = t.next(c);
 		}
 	}
 
@@ -73,80 +72,32 @@ class DNA {
 	}
 
 	void output() {
+		vector<int> a(n);
+		t.toArray(&a[0]);
 		printf("The shortest length is: %f.\nAnd the tour is:", len);
 		for (int i = 0; i < n; ++i) {
-			printf(" %d", a[i]+1);
+			printf(" %d", cityId(a[i])+1);
 		}
 		printf("\n");
 	}
-} seeds[MAX_SEED];
+};
 
 /* load the data */
 void loadFile(char* filename) {
-	FILE *pf;
-
-	pf = fopen(filename, "r");
-	if (pf == NULL) {
-		printf("Cannot open the file!\n");
-		exit(1);
-	}
-	char buff[200];
-	fscanf(pf, "NAME: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nTYPE: TSP%[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nCOMMENT: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nDIMENSION: %d", &n);
-	printf("The N is: %d\n", n);
-	fscanf(pf, "\nEDGE_WEIGHT_TYPE: %[^\n]s", buff);
-	printf("the type is: %s\n", buff);
-	memset(dist, 0, sizeof(dist));
-	if (strcmp(buff, "EUC_2D") == 0) {
-		fscanf(pf, "\nNODE_COORD_SECTION");
-		float nodeCoord[N][2] = {};
-		int nid;
-		float xx, yy;
-		for (int i = 0; i < n; ++i) {
-			fscanf(pf, "\n%d %f %f", &nid, &xx, &yy);
-			nodeCoord[i][0] = xx;
-			nodeCoord[i][1] = yy;
-		}
-		float xi, yi, xj, yj;
-		for (int i = 0; i < n; ++i) {
-			for (int j = i + 1; j < n; ++j) {
-				xi = nodeCoord[i][0];
-				yi = nodeCoord[i][1];
-				xj = nodeCoord[j][0];
-				yj = nodeCoord[j][1];
-				dist[i][j] = (float)sqrt((xi - xj) * (xi - xj) + (yi - yj) * (yi - yj));
-				dist[j][i] = dist[i][j];
-			}
-		}
-	}
-	else if (strcmp(buff, "EXPLICIT") == 0) {
-		fscanf(pf, "\nEDGE_WEIGHT_FORMAT: %[^\n]s", buff);
-		fscanf(pf, "\n%[^\n]s", buff);
-		char *disps = strstr(buff, "DISPLAY_DATA_TYPE");
-		if (disps != NULL) {
-			fscanf(pf, "\nEDGE_WEIGHT_SECTION");
-		}
-		float weight;
-		for (int i = 0; i < n; ++i) {
-			for (int j = 0; j <= i; ++j) {
-				fscanf(pf, "%f", &weight);
-				dist[i][j] = weight;
-				dist[j][i] = weight;
-			}
-		}
-	}
+	TSPInstance inst;
+	loadTSPLIB(filename, inst);
+	printInstance(inst);
+	n = inst.n;
+	initDistance(inst, optionValue("dist", "auto"));
+	freeInstance(inst);
 }
 
 double newRand() {
-	return rand() % (int)1E9 / 1E9;
+	return rng.uniform();
 }
 
-int mateChoose(DNA seeds[]) {
+template<class TourT>
+int mateChoose(DNA<TourT> seeds[]) {
 	float maxLen = seeds[REMAIN - 1].len;
 	float tot = 0.0;
 	for (int i = 0; i < REMAIN; ++i) {
@@ -164,19 +115,20 @@ int mateChoose(DNA seeds[]) {
 	return ret;
 }
 
-DNA mate(const DNA &a, const DNA &b) {
-	static int prevA[N], nextA[N], prevB[N], nextB[N];
+template<class TourT>
+DNA<TourT> mate(const DNA<TourT> &a, const DNA<TourT> &b) {
+	static vector<int> prevA(n), nextA(n), prevB(n), nextB(n);
 	vector<int> ret(n);
 	for (int i = 0; i < n; ++i) {
-		nextA[a.a[i]] = a.a[(i + 1) % n];
-		prevA[a.a[(i + 1) % n]] = a.a[i];
-		nextB[b.a[i]] = b.a[(i + 1) % n];
-		prevB[b.a[(i + 1) % n]] = b.a[i];
+		nextA[i] = a.t.next(i);
+		prevA[i] = a.t.prev(i);
+		nextB[i] = b.t.next(i);
+		prevB[i] = b.t.prev(i);
 	}
-	ret[0] = rand() % n;
+	ret[0] = rng.bounded(n);
 	for (int i = 0; i < n - 1; ++i) {
 		int k = ret[i];
-		if (dist[k][nextA[k]] < dist[k][nextB[k]]) {
+		if (getDist(k, nextA[k]) < getDist(k, nextB[k])) {
 			ret[i + 1] = nextA[k];
 		} else {
 			ret[i + 1] = nextB[k];
@@ -186,49 +138,44 @@ DNA mate(const DNA &a, const DNA &b) {
 		nextB[prevB[k]] = nextB[k];
 		prevB[nextB[k]] = prevB[k];
 	}
-	return DNA(ret);
+	return DNA<TourT>(ret);
 }
 
-void mutate(DNA &a) {
-	int l = rand() % n, r = rand() % n;
-	if (abs(l - r) == n - 1) {
-		r = rand() % (n - 1);
-		l = rand() % (n - 2);
-	}
-	if (l == r) {
-		r = (r + 2) % n;
-	}
-	if (l > r) {
-		swap(l, r);
-	}
-	++r;
-	reverse(a.a.begin() + l, a.a.begin() + r);
-	a.calcLen();
+/* random 2-opt: (x, next x) + (y, next y) -> (x, y) + (next x, next y) */
+template<class TourT>
+void mutate(DNA<TourT> &a) {
+	if (n < 4) {
+		return;
+	}
+	int x, y, nx, ny;
+	do {
+		x = rng.bounded(n);
+		y = rng.bounded(n);
+		nx = a.t.next(x);
+		ny = a.t.next(y);
+	} while (x == y || y == nx || ny == x);
+	a.len += getDist(x, y) + getDist(nx, ny) - getDist(x, nx) - getDist(y, ny);
+	make2opt(a.t, x, nx, y, ny);
 }
 
-int main(int argc, char **argv) {
-	if (argc < 2) {
-		printf("Please enter the filename!\n");
-		return 0;
-	}
-	else {
-		loadFile(argv[1]);
-	}
-	srand(time(NULL));
+/* evolve MAX_SEED tours of type TourT for MAX_ITER generations */
+template<class TourT>
+void runGA() {
+	vector< DNA<TourT> > seeds(MAX_SEED);
 	struct timeval start, stop;
 	gettimeofday(&start, NULL);
 
 	for (int i = 0; i < MAX_SEED; ++i) {
-		seeds[i] = DNA(n);
+		seeds[i] = DNA<TourT>(n);
 	}
-	sort(seeds, seeds + MAX_SEED);
+	sort(seeds.begin(), seeds.end());
 	for (int t = 0; t < MAX_ITER; ++t) {
 		for (int i = REMAIN; i < MAX_SEED; ++i) {
 			double pMate = newRand();
 			if (pMate > PMATE) {
 				continue;
 			}
-			int p = mateChoose(seeds), q = mateChoose(seeds);
+			int p = mateChoose(&seeds[0]), q = mateChoose(&seeds[0]);
 			if (p == q) {
 				seeds[i] = seeds[p];
 			} else {
@@ -241,7 +188,7 @@ int main(int argc, char **argv) {
 				mutate(seeds[i]);
 			}
 		}
-		sort(seeds, seeds + MAX_SEED);
+		sort(seeds.begin(), seeds.end());
 		if (t % 100 == 0) {
 			cerr << t << ": " << seeds[0].len << endl;
 		}
@@ -255,6 +202,25 @@ int main(int argc, char **argv) {
 	printf("Total time usage: %d min %d sec. \n", timemin, timesec);
 
 	seeds[0].output();
+}
+
+int main(int argc, char **argv) {
+	argc = parseOptions(argc, argv);
+	if (argc < 2) {
+		printf("Please enter the filename!\n");
+		return 0;
+	}
+	else {
+		loadFile(argv[1]);
+	}
+	rng.seed(initRng(), 0);
+	printf("Seed=%llu\n", (unsigned long long)rngSeed);
+	initConstruct("nn");
+	if (parseTourMode(optionValue("tour", "array")) == TOUR_TWOLEVEL) {
+		runGA<TwoLevelTour>();
+	} else {
+		runGA<ArrayTour>();
+	}
 
 	return 0;
 }
@@ -2,21 +2,24 @@
 #include <vector>
 
 #include "../../utils/serialization.hpp"
+#include "../../../utils/distance.hpp"
+#include "../../../utils/rng.hpp"
 
 using namespace std;
 
-#define N 1000
 #define INIT_TEMP 99
 #define STOP_TEMP 0.01
 #define RATIO 0.999
 
+Rng randGen;	// seeded per worker, see sa_worker.cpp
+
 class TSP {
 	public:
 		TSP(): contCnt(0) {
 			for (int i = 0; i < n; ++i) {
 				tour.push_back(i);
 			}
-			random_shuffle(tour.begin(), tour.end());
+			randGen.shuffle(tour.data(), n);
 			preLen = curLen = getLength();
 			halt = false;
 		}
@@ -27,9 +30,9 @@ class TSP {
 			}
 			float ret = 0.0;
 			for (int i = 1; i < n; ++i) {
-				ret += dist[tour[i - 1]][tour[i]];
+				ret += getDist(tour[i - 1], tour[i]);
 			}
-			ret += dist[tour.back()][tour[0]];
+			ret += getDist(tour.back(), tour[0]);
 			return ret;
 		}
 
@@ -38,19 +41,18 @@ class TSP {
 /*
 			printf("The shortest length is: %f\nAnd the tour is:", curLen);
 			for (int i = 0; i < (int)tour.size(); ++i) {
-				printf(" %d", tour[i] + 1);
+				printf(" %d", cityId(tour[i]) + 1);
 			}
 			printf("\n");
 */
 		}
 
 		vector<int> tour;
-		float curLen, preLen;
+		double curLen, preLen;
 		int contCnt;
 		bool halt;
 		
 		static int n;
-		static float dist[N][N];
 };
 
 obinstream &operator<<(obinstream &bout, const TSP &tsp) {
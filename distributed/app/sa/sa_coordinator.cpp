@@ -10,7 +10,6 @@
 using namespace std;
 
 int TSP::n;
-float TSP::dist[N][N];
 
 int main() {
 	init();
@@ -16,6 +16,9 @@
 #include <sys/time.h>
 #include <pthread.h>
 #include <curand_kernel.h>
+#include "../../utils/tsplib.hpp"
+#include "../../utils/options.hpp"
+#include "../../utils/rng.hpp"
 #define MAXITER 20		// Proposal 20 routes and then select the best one
 #define THRESH1 0.1		// Threshold 1 for the strategy
 #define THRESH2 0.89	// Threshold 2 for the strategy
@@ -24,7 +27,6 @@
 #define INITEMP 99.0	// Initial temperature
 #define STOPTEMP 0.001	// Termination temperature
 #define MAXLAST 3		// Stop if the tour length keeps unchanged for MAXLAST consecutive temperature
-#define MAXN 250		// only support N <= 250
 #define THREADITER 200
 using namespace std;
 
@@ -39,83 +41,14 @@ int threadNum = 1;	// thread number
 int globalIter = -1;	// global iteration count
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-class rand_x { 
-    unsigned int seed;
-public:
-    rand_x(int init) : seed(init) {}
-
-    int operator()(int limit) {
-        int divisor = RAND_MAX/(limit+1);
-        int retval;
-
-        do { 
-            retval = rand_r(&seed) / divisor;
-        } while (retval > limit);
-
-        return retval;
-    }        
-};
-
 /* load the data */
 void loadFile(char* filename) {
-	FILE *pf;
-
-	pf = fopen(filename, "r");
-	if (pf == NULL) {
-		printf("Cannot open the file!\n");
-		exit(1);
-	}
-	char buff[200];
-	fscanf(pf, "NAME: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nTYPE: TSP%[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nCOMMENT: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nDIMENSION: %d", &N);
-	printf("The N is: %d\n", N);
-	fscanf(pf, "\nEDGE_WEIGHT_TYPE: %[^\n]s", buff);
-	printf("the type is: %s\n", buff);
-	dist = (float *)malloc(sizeof(float) * N * N);
-	memset(dist, 0, sizeof(float) * N * N);
-	if (strcmp(buff, "EUC_2D") == 0) {
-		fscanf(pf, "\nNODE_COORD_SECTION");
-		float nodeCoord[MAXN][2] = {};
-		int nid;
-		float xx, yy;
-		for (int i = 0; i < N; ++i) {
-			fscanf(pf, "\n%d %f %f", &nid, &xx, &yy);
-			nodeCoord[i][0] = xx;
-			nodeCoord[i][1] = yy;
-		}
-		float xi, yi, xj, yj;
-		for (int i = 0; i < N; ++i) {
-			for (int j = i + 1; j < N; ++j) {
-				xi = nodeCoord[i][0];
-				yi = nodeCoord[i][1];
-				xj = nodeCoord[j][0];
-				yj = nodeCoord[j][1];
-				dist[i*N + j] = (float)sqrt((xi - xj) * (xi - xj) + (yi - yj) * (yi - yj));
-				dist[j*N + i] = dist[i*N + j];
-			}
-		}
-	}
-	else if (strcmp(buff, "EXPLICIT") == 0) {
-		fscanf(pf, "\nEDGE_WEIGHT_FORMAT: %[^\n]s", buff);
-		fscanf(pf, "\n%[^\n]s", buff);
-		char *disps = strstr(buff, "DISPLAY_DATA_TYPE");
-		if (disps != NULL) {
-			fscanf(pf, "\nEDGE_WEIGHT_SECTION");
-		}
-		float weight;
-		for (int i = 0; i < N; ++i) {
-			for (int j = 0; j <= i; ++j) {
-				fscanf(pf, "%f", &weight);
-				dist[i*N + j] = weight;
-				dist[j*N + i] = weight;
-			}
-		}
-	}
+	TSPInstance inst;
+	loadTSPLIB(filename, inst);
+	printInstance(inst);
+	N = inst.n;
+	dist = buildDistMatrix(inst);
+	freeInstance(inst);
 	return;
 }
 
@@ -172,16 +105,33 @@ __global__ void saTSP(int cityCnt, int* globalTour, curandState *randStates,  fl
 			int tp = tour[p], tq = tour[q], tp1 = tour[p1], tq1 = tour[q1];
 			float delta = dev_dist[tp*cityCnt + tq1] + dev_dist[tp1*cityCnt + tq] - dev_dist[tp*cityCnt + tp1] - dev_dist[tq*cityCnt + tq1];
 
-			/* whether to accept the change */
+			/* whether to accept the change, -DSA_ACCEPT_LOG: delta < -T*ln(u) with the fast __logf intrinsic */
+#ifdef SA_ACCEPT_LOG
+			if ((delta < 0) || ((delta > 0) &&
+				(delta < -temperature * __logf(curand_uniform(&(randStates[thid])))))) {
+#else
 			if ((delta < 0) || ((delta > 0) && 
 				(expf(-delta/temperature) > curand_uniform(&(randStates[thid]))))) {
+#endif
 				currLen = currLen + delta;
-				int mid = (q - p) >> 1;
+				/* reverse tour[p..q] or the complement tour[q+1..p-1], whichever is shorter */
+				int len = q - p + 1;
+				if (2 * len > cityCnt) {
+					int np = q + 1;
+					q = p - 1 + cityCnt;
+					p = np;
+					len = cityCnt - len;
+				}
 				int tmp;
-				for (int k = 0; k <= mid; ++k) {
-					tmp = tour[p+k];
-					tour[p+k] = tour[q-k];
-					tour[q-k] = tmp;
+				for (int k = 0; k < len / 2; ++k) {
+					int i = p + k, j = q - k;
+					if (i >= cityCnt)
+						i -= cityCnt;
+					if (j >= cityCnt)
+						j -= cityCnt;
+					tmp = tour[i];
+					tour[i] = tour[j];
+					tour[j] = tmp;
 				}
 				//currLen = tourLen(tour);
 			}
@@ -207,13 +157,14 @@ __global__ void saTSP(int cityCnt, int* globalTour, curandState *randStates,  fl
 __global__ void setup_kernel_randomness(curandState * state, unsigned long seed)
 {
 	int s_id = (blockIdx.x*blockDim.x) + threadIdx.x;
-	curand_init(seed*s_id, s_id, 0, &state[s_id]);
+	curand_init(seed, s_id, 0, &state[s_id]);	// one subsequence per thread
 }
 
 int main(int argc, char **argv) {
 	cudaError_t err = cudaSuccess;
 	float *dev_dist;
 	
+	argc = parseOptions(argc, argv);
 	if (argc < 2) {
 		printf("Usage: ./cuda_tsp <filename> <blockNum> <threadNum>\n");
 		return 0;
@@ -232,10 +183,10 @@ int main(int argc, char **argv) {
 		blockNum = atoi(argv[2]);
 		threadNum = atoi(argv[3]);
 	}
-	printf("blockNum is: %d, threadNum is: %d\n", blockNum, threadNum);
+	initRng();
+	printf("blockNum is: %d, threadNum is: %d, seed is: %llu\n", blockNum, threadNum, (unsigned long long)rngSeed);
 	struct timeval start, stop;
 	gettimeofday(&start, NULL);
-	srandom(time(0));
 	int *dev_currTour; // currTour on device;
 	int itersCnt = blockNum * threadNum; // total iterations
 	err = cudaMalloc((void **)&dev_currTour, sizeof(int)*N*itersCnt);
@@ -244,13 +195,13 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
-	srand(time(0));
+	Rng rng(rngSeed, 0);
 	currTour = (int *)malloc(sizeof(int) * N * itersCnt);
 	for (int i = 0; i < itersCnt; ++i) {
 		for (int j = 0; j < N; ++j) {
 			currTour[i*N + j] = j;
 		}
-		random_shuffle(currTour+i*N, currTour+(i+1)*N);
+		rng.shuffle(currTour+i*N, N);
 		/*for (int j = 0; j < N; ++j) {
 			printf("%d ", currTour[i*N + j]);
 		}
@@ -265,7 +216,7 @@ int main(int argc, char **argv) {
 	// allocate random seed for each thread
 	curandState *devStates;
 	cudaMalloc((void **)&devStates, itersCnt * sizeof(curandState));	
-	setup_kernel_randomness<<<blockNum, threadNum>>>(devStates, time(0));
+	setup_kernel_randomness<<<blockNum, threadNum>>>(devStates, rngSeed);
 	cudaDeviceSynchronize();
 
 	float currLen = 0;
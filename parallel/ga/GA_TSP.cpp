@@ -1,6 +1,7 @@
 /*
 	Genetic algorithm for Traveling Salesman Problem
-	@@ baseline version: no parallel optimization, single thread
+	@@ parallel version: building, mating and mutating the population run
+	   as chunked tasks on a work-stealing pool
 	
 	Input: xxx.tsp file
 	Output: optimal value (total distance)
@@ -16,55 +17,57 @@
 #include <algorithm>
 #include <sys/time.h>
 
+#include "../../utils/options.hpp"
+#include "../../utils/distance.hpp"
+#include "../../utils/tour.hpp"
+#include "../../utils/rng.hpp"
+#include "../../utils/construct.hpp"
+#include "../../utils/pool.hpp"
+
 using namespace std;
 
-const int N = 1000;
 const int MAX_SEED = 1000;
 const int MAX_ITER = 10000;
 const float PMATE = 0.95;
 const float PMUTATE = 0.9;
 const int REMAIN = MAX_SEED / 100;
 const int BESTS = 3;
+const int CHUNK = 50;		// individuals per task
 
-float dist[N][N] = {};	// The distance matrix, use (i-1) instead of i
 int n;
+int nthreads = 1;
+TaskPool pool;
 
+/* TourT is a utils/tour.hpp representation, picked with --tour=array|twolevel */
+template<class TourT>
 class DNA {
 	public:
-	vector<int> a;
+	TourT t;
 	int n;
 	double len;
 
 	DNA() {
 	}
 
-	DNA(int _n): n(_n) {
-		a.resize(n);
-		for (int i = 0; i < n; ++i) {
-			a[i] = i;
-		}
-		random_shuffle(a.begin(), a.end());
-		for (int i = 0; i < n - 1; ++i) {
-			int k = i + 1;
-			for (int j = i + 2; j < n; ++j) {
-				if (dist[a[i]][a[j]] < dist[a[i]][a[k]]) {
-					k = j;
-				}
-			}
-			swap(a[i + 1], a[k]);
-		}
+	DNA(int _n, Rng &rng): n(_n) {
+		vector<int> a(n);
+		buildTour(&a[0], rng);		// --init, nearest neighbor by default
+		t.init(&a[0], n);
 		calcLen();
 	}
 
-	DNA(const vector<int> &_a): a(_a) {
+	DNA(const vector<int> &a) {
 		n = a.size();
+		t.init(&a[0], n);
 		calcLen();
 	}
 
 	void calcLen() {
 		len = 0.0;
+		int c = 0;
 		for (int i = 0; i < n; ++i) {
-			len += dist[a[i]][a[(i + 1) % n]];
+			len += getDist(c, t.next(c));
+			c = t.next(c);
 		}
 	}
 
@@ -73,86 +76,38 @@ class DNA {
 	}
 
 	void output() {
+		vector<int> a(n);
+		t.toArray(&a[0]);
 		printf("The shortest length is: %f.\nAnd the tour is:", len);
 		for (int i = 0; i < n; ++i) {
-			printf(" %d", a[i]+1);
+			printf(" %d", cityId(a[i])+1);
 		}
 		printf("\n");
 	}
-} seeds[MAX_SEED];
+};
 
 /* load the data */
 void loadFile(char* filename) {
-	FILE *pf;
-
-	pf = fopen(filename, "r");
-	if (pf == NULL) {
-		printf("Cannot open the file!\n");
-		exit(1);
-	}
-	char buff[200];
-	fscanf(pf, "NAME: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nTYPE: TSP%[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nCOMMENT: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nDIMENSION: %d", &n);
-	printf("The N is: %d\n", n);
-	fscanf(pf, "\nEDGE_WEIGHT_TYPE: %[^\n]s", buff);
-	printf("the type is: %s\n", buff);
-	memset(dist, 0, sizeof(dist));
-	if (strcmp(buff, "EUC_2D") == 0) {
-		fscanf(pf, "\nNODE_COORD_SECTION");
-		float nodeCoord[N][2] = {};
-		int nid;
-		float xx, yy;
-		for (int i = 0; i < n; ++i) {
-			fscanf(pf, "\n%d %f %f", &nid, &xx, &yy);
-			nodeCoord[i][0] = xx;
-			nodeCoord[i][1] = yy;
-		}
-		float xi, yi, xj, yj;
-		for (int i = 0; i < n; ++i) {
-			for (int j = i + 1; j < n; ++j) {
-				xi = nodeCoord[i][0];
-				yi = nodeCoord[i][1];
-				xj = nodeCoord[j][0];
-				yj = nodeCoord[j][1];
-				dist[i][j] = (float)sqrt((xi - xj) * (xi - xj) + (yi - yj) * (yi - yj));
-				dist[j][i] = dist[i][j];
-			}
-		}
-	}
-	else if (strcmp(buff, "EXPLICIT") == 0) {
-		fscanf(pf, "\nEDGE_WEIGHT_FORMAT: %[^\n]s", buff);
-		fscanf(pf, "\n%[^\n]s", buff);
-		char *disps = strstr(buff, "DISPLAY_DATA_TYPE");
-		if (disps != NULL) {
-			fscanf(pf, "\nEDGE_WEIGHT_SECTION");
-		}
-		float weight;
-		for (int i = 0; i < n; ++i) {
-			for (int j = 0; j <= i; ++j) {
-				fscanf(pf, "%f", &weight);
-				dist[i][j] = weight;
-				dist[j][i] = weight;
-			}
-		}
-	}
+	TSPInstance inst;
+	loadTSPLIB(filename, inst);
+	printInstance(inst);
+	n = inst.n;
+	initDistance(inst, optionValue("dist", "auto"));
+	freeInstance(inst);
 }
 
-double newRand() {
-	return rand() % (int)1E9 / 1E9;
+double newRand(Rng &rng) {
+	return rng.uniform();
 }
 
-int mateChoose(DNA seeds[]) {
+template<class TourT>
+int mateChoose(DNA<TourT> seeds[], Rng &rng) {
 	float maxLen = seeds[REMAIN - 1].len;
 	float tot = 0.0;
 	for (int i = 0; i < REMAIN; ++i) {
 		tot += maxLen / seeds[i].len;
 	}
-	tot *= newRand();
+	tot *= newRand(rng);
 	int ret;
 	for (int i = 0; i < REMAIN; ++i) {
 		tot -= maxLen / seeds[i].len;
@@ -164,19 +119,20 @@ int mateChoose(DNA seeds[]) {
 	return ret;
 }
 
-DNA mate(const DNA &a, const DNA &b) {
-	static int prevA[N], nextA[N], prevB[N], nextB[N];
+template<class TourT>
+DNA<TourT> mate(const DNA<TourT> &a, const DNA<TourT> &b, Rng &rng) {
+	static thread_local vector<int> prevA(n), nextA(n), prevB(n), nextB(n);
 	vector<int> ret(n);
 	for (int i = 0; i < n; ++i) {
-		nextA[a.a[i]] = a.a[(i + 1) % n];
-		prevA[a.a[(i + 1) % n]] = a.a[i];
-		nextB[b.a[i]] = b.a[(i + 1) % n];
-		prevB[b.a[(i + 1) % n]] = b.a[i];
+		nextA[i] = a.t.next(i);
+		prevA[i] = a.t.prev(i);
+		nextB[i] = b.t.next(i);
+		prevB[i] = b.t.prev(i);
 	}
-	ret[0] = rand() % n;
+	ret[0] = rng.bounded(n);
 	for (int i = 0; i < n - 1; ++i) {
 		int k = ret[i];
-		if (dist[k][nextA[k]] < dist[k][nextB[k]]) {
+		if (getDist(k, nextA[k]) < getDist(k, nextB[k])) {
 			ret[i + 1] = nextA[k];
 		} else {
 			ret[i + 1] = nextB[k];
@@ -186,62 +142,98 @@ DNA mate(const DNA &a, const DNA &b) {
 		nextB[prevB[k]] = nextB[k];
 		prevB[nextB[k]] = prevB[k];
 	}
-	return DNA(ret);
+	return DNA<TourT>(ret);
 }
 
-void mutate(DNA &a) {
-	int l = rand() % n, r = rand() % n;
-	if (abs(l - r) == n - 1) {
-		r = rand() % (n - 1);
-		l = rand() % (n - 2);
-	}
-	if (l == r) {
-		r = (r + 2) % n;
+/* random 2-opt: (x, next x) + (y, next y) -> (x, y) + (next x, next y) */
+template<class TourT>
+void mutate(DNA<TourT> &a, Rng &rng) {
+	if (n < 4) {
+		return;
 	}
-	if (l > r) {
-		swap(l, r);
-	}
-	++r;
-	reverse(a.a.begin() + l, a.a.begin() + r);
-	a.calcLen();
+	int x, y, nx, ny;
+	do {
+		x = rng.bounded(n);
+		y = rng.bounded(n);
+		nx = a.t.next(x);
+		ny = a.t.next(y);
+	} while (x == y || y == nx || ny == x);
+	a.len += getDist(x, y) + getDist(nx, ny) - getDist(x, nx) - getDist(y, ny);
+	make2opt(a.t, x, nx, y, ny);
 }
 
-int main(int argc, char **argv) {
-	if (argc < 2) {
-		printf("Please enter the filename!\n");
-		return 0;
-	}
-	else {
-		loadFile(argv[1]);
-	}
-	srand(time(NULL));
-	struct timeval start, stop;
-	gettimeofday(&start, NULL);
+enum { GA_INIT, GA_MATE, GA_MUTATE };
 
-	for (int i = 0; i < MAX_SEED; ++i) {
-		seeds[i] = DNA(n);
-	}
-	sort(seeds, seeds + MAX_SEED);
-	for (int t = 0; t < MAX_ITER; ++t) {
-		for (int i = REMAIN; i < MAX_SEED; ++i) {
-			double pMate = newRand();
+/*
+	individuals [from, to) of one step of generation gen. Every chunk has
+	its own Rng stream, so the run only depends on --seed, not on the
+	number of threads.
+*/
+template<class TourT>
+struct GaChunk {
+	vector< DNA<TourT> > *seeds;
+	int kind;
+	int gen;
+	int from, to;
+};
+
+template<class TourT>
+void gaChunk(void *arg) {
+	GaChunk<TourT> *c = (GaChunk<TourT> *)arg;
+	vector< DNA<TourT> > &seeds = *c->seeds;
+	Rng rng(rngSeed, ((uint64_t)c->gen * 3 + c->kind) * MAX_SEED + c->from);
+	for (int i = c->from; i < c->to; ++i) {
+		if (c->kind == GA_INIT) {
+			seeds[i] = DNA<TourT>(n, rng);
+		} else if (c->kind == GA_MATE) {
+			double pMate = newRand(rng);
 			if (pMate > PMATE) {
 				continue;
 			}
-			int p = mateChoose(seeds), q = mateChoose(seeds);
+			int p = mateChoose(&seeds[0], rng), q = mateChoose(&seeds[0], rng);
 			if (p == q) {
 				seeds[i] = seeds[p];
 			} else {
-				seeds[i] = mate(seeds[p], seeds[q]);
+				seeds[i] = mate(seeds[p], seeds[q], rng);
 			}
-		}
-		for (int i = BESTS; i < MAX_SEED; ++i) {
-			double pMutate = newRand();
+		} else {
+			double pMutate = newRand(rng);
 			if (pMutate <= PMUTATE) {
-				mutate(seeds[i]);
+				mutate(seeds[i], rng);
 			}
 		}
-		sort(seeds, seeds + MAX_SEED);
+	}
+}
+
+/* run one step over individuals [from, MAX_SEED) on the pool */
+template<class TourT>
+void gaStep(vector< DNA<TourT> > &seeds, int kind, int gen, int from) {
+	static vector< GaChunk<TourT> > chunks;
+	chunks.clear();
+	for (int i = from; i < MAX_SEED; i += CHUNK) {
+		GaChunk<TourT> c = { &seeds, kind, gen, i, min(i + CHUNK, MAX_SEED) };
+		chunks.push_back(c);
+	}
+	for (size_t k = 0; k < chunks.size(); ++k) {
+		pool.submit(gaChunk<TourT>, &chunks[k]);
+	}
+	pool.wait();
+}
+
+/* evolve MAX_SEED tours of type TourT for MAX_ITER generations */
+template<class TourT>
+void runGA() {
+	vector< DNA<TourT> > seeds(MAX_SEED);
+	struct timeval start, stop;
+	gettimeofday(&start, NULL);
+
+	gaStep(seeds, GA_INIT, 0, 0);
+	sort(seeds.begin(), seeds.end());
+	for (int t = 0; t < MAX_ITER; ++t) {
+		/* mating reads only the REMAIN parents, mutation may touch them, so two steps */
+		gaStep(seeds, GA_MATE, t, REMAIN);
+		gaStep(seeds, GA_MUTATE, t, BESTS);
+		sort(seeds.begin(), seeds.end());
 		if (t % 100 == 0) {
 			cerr << t << ": " << seeds[0].len << endl;
 		}
@@ -255,6 +247,31 @@ int main(int argc, char **argv) {
 	printf("Total time usage: %d min %d sec. \n", timemin, timesec);
 
 	seeds[0].output();
+}
+
+int main(int argc, char **argv) {
+	argc = parseOptions(argc, argv);
+	if (argc < 2) {
+		printf("Please enter the filename!\n");
+		return 0;
+	}
+	else {
+		loadFile(argv[1]);
+	}
+	if (argc > 2) {
+		nthreads = atoi(argv[2]);
+	}
+	initRng();
+	printf("Processor=%d, Seed=%llu\n", nthreads, (unsigned long long)rngSeed);
+	pool.init(nthreads);
+	pool.start();
+	initConstruct("nn");
+	if (parseTourMode(optionValue("tour", "array")) == TOUR_TWOLEVEL) {
+		runGA<TwoLevelTour>();
+	} else {
+		runGA<ArrayTour>();
+	}
+	pool.stop();
 
 	return 0;
 }
@@ -0,0 +1,104 @@
+/*
+	Simulated Annealing algorithm for Traveling Salesman Problem
+	@@ lane version: the CUDA design (cuda/cuda_SA_TSP.cu) on SIMD lanes,
+	one chain per lane, blocks of LANES chains spread over OpenMP threads
+
+	Input: xxx.tsp file
+	Output: optimal value (total distance)
+			& solution route: permutation of {1, 2, ..., N}
+
+	Usage: ./lane_out <filename> <threads> [blockNum]
+	blockNum (default: threads) blocks of LANES chains each, build with
+	DEFS=-march=native for the AVX-512 / AVX2 lanes.
+*/
+
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <sys/time.h>
+#include <omp.h>
+#define RELAX 400		// The times of relaxation of the same temperature, as in the CUDA kernel
+#include "../utils/options.hpp"
+#include "../utils/distance.hpp"
+#include "../utils/lanes.hpp"
+using namespace std;
+
+float minTourDist = -1;		// The distance of shortest path
+int *minTour = NULL;		// The shortest path
+int N = 0;					// Number of cities
+
+/* load the data */
+void loadFile(char* filename) {
+	TSPInstance inst;
+	loadTSPLIB(filename, inst);
+	printInstance(inst);
+	N = inst.n;
+	initDistance(inst, optionValue("dist", "auto"));
+	freeInstance(inst);
+	return;
+}
+
+int main(int argc, char **argv) {
+	argc = parseOptions(argc, argv);
+	int nprocess = 1;
+	if (argc < 2) {
+		printf("Please enter the filename!\n");
+		return 0;
+	}
+	else {
+		loadFile(argv[1]);
+	}
+	if (N < 5) {
+		fprintf(stderr, "The lane version needs N >= 5 cities!\n");
+		exit(1);
+	}
+	/* the dense float matrix is gathered with 32-bit offsets a * N + b */
+	if (distMode == DIST_DENSE && distType == DTYPE_FLOAT && (long long)N * N >= (1LL << 31)) {
+		fprintf(stderr, "The lane version needs N < 46341 cities with a dense float matrix, try --dist=coord or --dist=packed!\n");
+		exit(1);
+	}
+	if (argc > 2) {
+		nprocess = atoi(argv[2]);
+	}
+	int blockNum = (argc > 3) ? atoi(argv[3]) : nprocess;
+	initRng();
+	printf("Blocks=%d, Lanes=%d, Processor=%d, Seed=%llu, %s\n", blockNum, LANES, nprocess, (unsigned long long)rngSeed, argv[1]);
+	struct timeval start, stop;
+	gettimeofday(&start, NULL);
+	minTour = (int *)malloc(sizeof(int) * N);
+	#pragma omp parallel num_threads(nprocess)
+	{
+		int *currTour = (int *)malloc(sizeof(int) * N);
+		#pragma omp for schedule(dynamic)
+		for (int b = 0; b < blockNum; ++b) {
+			LaneBlock blk;
+			laneInit(blk, N, b * LANES);	// chain c uses Rng stream c
+			laneAnneal(blk, N, INITEMP);
+			for (int l = 0; l < LANES; ++l) {
+				laneTour(blk, N, l, currTour);
+				float currLen = tourLen(currTour);
+				#pragma omp critical
+				if ((minTourDist < 0) || (currLen < minTourDist)) {
+					minTourDist = currLen;
+					memcpy(minTour, currTour, sizeof(int) * N);
+				}
+			}
+			laneFree(blk);
+		}
+		free(currTour);
+	}
+	gettimeofday(&stop, NULL);
+	// ------------- Print the result! -----------------
+	double tottime = stop.tv_sec - start.tv_sec + (stop.tv_usec - start.tv_usec)/1000000.0;
+	printf("Total time usage: %.3lf sec. \n", tottime);
+	printf("The shortest length is: %f\n\n", minTourDist);
+	//for (int i = 0; i < N; ++i) {
+	//	printf("%d \n", cityId(minTour[i])+1);
+	//}
+	free(minTour);
+	freeDistance();
+	return 0;
+}
@@ -13,221 +13,405 @@
 #include <stdlib.h>
 #include <math.h>
 #include <algorithm>
+#include <map>
 #include <sys/time.h>
 #include <pthread.h>
 #include <omp.h>
 #ifndef MAXITER 
 	#define MAXITER 20		// Proposal 20 routes and then select the best one
 #endif
-#define THRESH1 0.1		// Threshold 1 for the strategy
-#define THRESH2 0.89	// Threshold 2 for the strategy
-#define RELAX 40000		// The times of relaxation of the same temperature
-#define ALPHA 0.999		// Cooling rate
-#define INITEMP 99.0	// Initial temperature
-#define STOPTEMP 0.001	// Termination temperature
-#define MAXLAST 3		// Stop if the tour length keeps unchanged for MAXLAST consecutive temperature
-#define MAXN 1000		// only support N <= 1000
+#define SAMELEN 1e-2	// Two lengths closer than this count as unchanged
+#include "../utils/options.hpp"
+#include "../utils/distance.hpp"
+#include "../utils/anneal.hpp"
+#include "../utils/restarts.hpp"
+#include "../utils/population.hpp"
+#include "../utils/numa.hpp"
 using namespace std;
 
 float minTourDist = -1;		// The distance of shortest path
 int *minTour = NULL;		// The shortest path
 int N = 0;					// Number of cities
-float dist[MAXN][MAXN] = {};	// The distance matrix, use (i-1) instead of i
-float currLen[1024]={};
-int *currTour[1024]={};
 int nprocess = 1;
-int globalIter = -1;	// global iteration count
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t mutex2 = PTHREAD_MUTEX_INITIALIZER;
 
-class rand_x { 
-    unsigned int seed;
-public:
-    rand_x(int init) : seed(init) {}
-
-    int operator()(int limit) {
-        int divisor = RAND_MAX/(limit+1);
-        int retval;
+/*
+	--pt: parallel tempering (replica exchange) instead of independent
+	restarts. The temperatures ptTemp[l] form a geometric ladder from
+	--ptmax down to --ptmin, one replica at each. The threads run
+	--ptsweeps sweeps (RELAX proposals each) on their replicas, meet at
+	a barrier, and the last thread to arrive swaps the replicas of
+	neighboring levels with probability
+	min(1, exp((1/T_l - 1/T_l+1) * (L_l - L_l+1))), even and odd pairs
+	in turn. --ptrounds such phases are run. An exchange swaps levels,
+	not tours: thread i owns replicas i, i + nprocess, ..., builds
+	their tours in its own arena and keeps annealing them there, and
+	each replica sits on its own cache lines.
+*/
+#define PT_REPLICAS 16		// Default number of replicas (rounded up to a multiple of the threads)
+#define PT_ROUNDS 2000		// Default number of exchange phases
+int ptReplicas = 0;
+int ptSweeps = 1;
+int ptRounds = 0;
+struct alignas(CACHE_LINE) PtReplica {
+	SaChain chain;			// never leaves its slot
+	int level;				// runs at ptTemp[level]
+	Rng rng;				// the stream of that level, moves with it
+};
 
-        do { 
-            retval = rand_r(&seed) / divisor;
-        } while (retval > limit);
+float *ptTemp = NULL;		// hottest first
+int *ptAt = NULL;			// level -> replica
+PtReplica *ptRep = NULL;
+Arena *ptArena = NULL;		// one per thread
+Rng ptSwapRng;
+long long ptTried = 0, ptSwapped = 0;
+pthread_barrier_t ptBarrier;
 
-        return retval;
-    }        
+/*
+	--shared: all threads anneal one tour, for instances too big to
+	anneal once per thread (ch71009). Each round is three phases
+	between barriers:
+	  1. every thread draws --spbatch 2-opt proposals (SP_BATCH) on the
+	     frozen tour from its own Rng stream, and keeps the ones the
+	     Metropolis test accepts
+	  2. one thread walks the accepted moves in (thread, draw) order and
+	     commits each one whose positions (the side applyReverse() will
+	     reverse and its two neighbors) overlap none committed before it
+	     in this round; the others are dropped as conflicts. Committed
+	     intervals are disjoint and kept ordered by start, so only the
+	     two around a new one can overlap it: O(log n) per move
+	  3. the threads apply the committed reversals, which are disjoint,
+	     so the deltas computed on the frozen tour stay exact
+	The tour therefore depends on --seed and the thread count only. A
+	temperature step is RELAX proposals over all threads, and the run
+	stops like saTSP(). Array tours only.
+*/
+#define SP_BATCH 64			// Default proposals per thread and round
+struct alignas(CACHE_LINE) SpThread {
+	Rng rng;				// stream 1 + thread
+	int cnt;				// accepted this round
+	int *p, *q;				// the accepted blocks
+	float *delta;
 };
 
+int spBatch = 0;
+int spRounds = 0;			// rounds per temperature step
+SpThread *spThr = NULL;
+Arena *spArena = NULL;		// one per thread
+SaChain spChain;			// the shared tour
+int *spP = NULL, *spQ = NULL, *spFirst = NULL, *spSpan = NULL;	// moves committed this round
+map<int, int> spByFirst;	// first position -> committed move
+int spCnt = 0;
+float spTemp = 0;
+int spRound = 0, spSame = 0;
+double spLastLen = 0;
+bool spDone = false;
+long long spAccepted = 0, spCommitted = 0;
+pthread_barrier_t spBarrier;
+
 /* load the data */
 void loadFile(char* filename) {
-	FILE *pf;
+	TSPInstance inst;
+	loadTSPLIB(filename, inst);
+	printInstance(inst);
+	N = inst.n;
+	initDistance(inst, optionValue("dist", "auto"));
+	freeInstance(inst);
+	return;
+}
 
-	pf = fopen(filename, "r");
-	if (pf == NULL) {
-		printf("Cannot open the file!\n");
-		exit(1);
-	}
-	char buff[200];
-	fscanf(pf, "NAME: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nTYPE: TSP%[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nCOMMENT: %[^\n]s", buff);
-	printf("%s\n", buff);
-	fscanf(pf, "\nDIMENSION: %d", &N);
-	printf("The N is: %d\n", N);
-	fscanf(pf, "\nEDGE_WEIGHT_TYPE: %[^\n]s", buff);
-	printf("the type is: %s\n", buff);
-	memset(dist, 0, sizeof(dist));
-	if (strcmp(buff, "EUC_2D") == 0) {
-		fscanf(pf, "\nNODE_COORD_SECTION");
-		float nodeCoord[MAXN][2] = {};
-		int nid;
-		float xx, yy;
-		for (int i = 0; i < N; ++i) {
-			fscanf(pf, "\n%d %f %f", &nid, &xx, &yy);
-			nodeCoord[i][0] = xx;
-			nodeCoord[i][1] = yy;
-		}
-		float xi, yi, xj, yj;
-		for (int i = 0; i < N; ++i) {
-			for (int j = i + 1; j < N; ++j) {
-				xi = nodeCoord[i][0];
-				yi = nodeCoord[i][1];
-				xj = nodeCoord[j][0];
-				yj = nodeCoord[j][1];
-				dist[i][j] = (float)sqrt((xi - xj) * (xi - xj) + (yi - yj) * (yi - yj));
-				dist[j][i] = dist[i][j];
-			}
+/* exchange phase of round r, run by one thread between two barriers */
+void ptExchange(int r) {
+	for (int l = r & 1; l + 1 < ptReplicas; l += 2) {
+		PtReplica &a = ptRep[ptAt[l]], &b = ptRep[ptAt[l + 1]];
+		float x = (1.0f / ptTemp[l] - 1.0f / ptTemp[l + 1]) * (a.chain.len - b.chain.len);
+		ptTried++;
+		if (x >= 0 || ptSwapRng.uniform() < exp(x)) {
+			swap(ptAt[l], ptAt[l + 1]);
+			swap(a.level, b.level);
+			swap(a.rng, b.rng);
+			ptSwapped++;
 		}
 	}
-	else if (strcmp(buff, "EXPLICIT") == 0) {
-		fscanf(pf, "\nEDGE_WEIGHT_FORMAT: %[^\n]s", buff);
-		fscanf(pf, "\n%[^\n]s", buff);
-		char *disps = strstr(buff, "DISPLAY_DATA_TYPE");
-		if (disps != NULL) {
-			fscanf(pf, "\nEDGE_WEIGHT_SECTION");
-		}
-		float weight;
-		for (int i = 0; i < N; ++i) {
-			for (int j = 0; j <= i; ++j) {
-				fscanf(pf, "%f", &weight);
-				dist[i][j] = weight;
-				dist[j][i] = weight;
-			}
+	for (int l = 0; l < ptReplicas; ++l) {
+		SaChain &c = ptRep[ptAt[l]].chain;
+		if ((minTourDist < 0) || (c.len < minTourDist)) {
+			minTourDist = c.len;
+			chainSync(c);
+			memcpy(minTour, c.tour, sizeof(int) * N);
 		}
 	}
-	return;
 }
 
-/* Calculate the length of the tour */
-float tourLen(int *tour) {
-	if (tour == NULL) {
-		printf("tour not exist!\n");
-		return -1;
+void *ptRoutine(void *idx) {
+	long tid = (long)idx;
+	pinSelf(tid);
+	for (int k = tid; k < ptReplicas; k += nprocess) {
+		int *tour = (int *)ptArena[tid].alloc(sizeof(int) * N);
+		buildTour(tour, ptRep[k].rng);
+		chainInit(ptRep[k].chain, tour, &ptArena[tid]);
 	}
-	float cnt = 0;
-	for (int i = 0; i < N - 1; ++i) {
-		cnt += dist[tour[i]][tour[i+1]];
+	pthread_barrier_wait(&ptBarrier);
+	for (int r = 0; r < ptRounds; ++r) {
+		numaBindThread();
+		for (int k = tid; k < ptReplicas; k += nprocess) {
+			for (int t = 0; t < ptSweeps; ++t)
+				chainRelax(ptRep[k].chain, ptTemp[ptRep[k].level], ptRep[k].rng);
+		}
+		if (pthread_barrier_wait(&ptBarrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+			ptExchange(r);
+		pthread_barrier_wait(&ptBarrier);
 	}
-	cnt += dist[tour[N-1]][tour[0]];
-	return cnt;
+	return NULL;
 }
 
-/* the main simulated annealing function */
-void saTSP(int* tour) {
-	float currLen = tourLen(tour);
-	float temperature = INITEMP;
-	float lastLen = currLen;
-	int contCnt = 0; // the continuous same length times
-	while (temperature > STOPTEMP) {
-		temperature *= ALPHA;
-		unsigned int s = time(0);
-		s = s + random();
-		/* stay in the same temperature for RELAX times */
-		for (int i = 0; i < RELAX; ++i) {
-			/* Proposal 1: Block Reverse between p and q */
-			int p = rand_r(&s)%N, q = rand_r(&s)%N;
-			// If will occur error if p=0 q=N-1...
-			if (abs(p - q) == N-1) {
-				q = rand_r(&s)%(N-1);
-				p = rand_r(&s)%(N-2);
-			}
-			if (p == q) {
-				q = (q + 2) % N;
-			}
-			if (p > q) {
-				int tmp = p;
-				p = q;
-				q = tmp;
-			}
-			int p1 = (p - 1 + N) % N;
-			int q1 = (q + 1) % N;
-			int tp = tour[p], tq = tour[q], tp1 = tour[p1], tq1 = tour[q1];
-			float delta = dist[tp][tq1] + dist[tp1][tq] - dist[tp][tp1] - dist[tq][tq1];
+/* parallel tempering on nprocess threads, the best tour ends up in minTour */
+void ptRun() {
+	ptReplicas = optionInt("replicas", (PT_REPLICAS + nprocess - 1) / nprocess * nprocess);
+	ptSweeps = optionInt("ptsweeps", 1);
+	ptRounds = optionInt("ptrounds", PT_ROUNDS);
+	double tMax = optionDouble("ptmax", 30.0), tMin = optionDouble("ptmin", 0.5);
+	if (ptReplicas < 2 || ptSweeps < 1 || ptRounds < 1 || tMin <= 0 || tMax < tMin) {
+		fprintf(stderr, "Bad parallel tempering options!\n");
+		exit(1);
+	}
+	printf("Parallel tempering: %d replicas, T = %g .. %g, %d rounds of %d sweeps\n",
+			ptReplicas, tMax, tMin, ptRounds, ptSweeps);
+	ptTemp = (float *)malloc(sizeof(float) * ptReplicas);
+	ptAt = (int *)malloc(sizeof(int) * ptReplicas);
+	ptRep = new PtReplica[ptReplicas];
+	ptArena = new Arena[nprocess];
+	for (int k = 0; k < ptReplicas; ++k) {
+		ptTemp[k] = tMax * pow(tMin / tMax, (double)k / (ptReplicas - 1));
+		ptAt[k] = k;
+		ptRep[k].level = k;
+		ptRep[k].rng.seed(rngSeed, k);
+	}
+	ptSwapRng.seed(rngSeed, ptReplicas);
+	pthread_barrier_init(&ptBarrier, NULL, nprocess);
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * nprocess);
+	for (long i = 0; i < nprocess; ++i) {
+		if (pthread_create(&threads[i], NULL, ptRoutine, (void *)i)) {
+			fprintf(stderr, "Fail to create thread! %ld\n", i);
+			exit(1);
+		}
+	}
+	for (int i = 0; i < nprocess; ++i) {
+		if (pthread_join(threads[i], NULL)) {
+			fprintf(stderr, "Fail to join thread!\n");
+			exit(1);
+		}
+	}
+	printf("Replica swaps accepted: %lld / %lld\n", ptSwapped, ptTried);
+	minTourDist = tourLen(minTour);
+	for (int k = 0; k < ptReplicas; ++k)
+		chainFree(ptRep[k].chain);
+	pthread_barrier_destroy(&ptBarrier);
+	free(threads);
+	free(ptTemp);
+	free(ptAt);
+	delete[] ptRep;
+	delete[] ptArena;
+}
 
-			/* whether to accept the change */
-			if ((delta < 0) || ((delta > 0) && 
-				(exp(-delta/temperature) > (float)rand_r(&s)/RAND_MAX))) {
-				currLen = currLen + delta;
-				int mid = (q - p) >> 1;
-				int tmp;
-				for (int k = 0; k <= mid; ++k) {
-					tmp = tour[p+k];
-					tour[p+k] = tour[q-k];
-					tour[q-k] = tmp;
-				}
-				//currLen = tourLen(tour);
-			}
+/* positions first .. first + span - 1 (mod N) and those of committed move c share one */
+inline bool spOverlap(int first, int span, int c) {
+	int N = distN;
+	return (first - spFirst[c] + N) % N < spSpan[c] || (spFirst[c] - first + N) % N < span;
+}
 
-		}
+/* the interval first .. first + span - 1 (mod N) overlaps a committed move */
+bool spConflict(int first, int span) {
+	if (spByFirst.empty())
+		return false;
+	/* the first committed start at or after first, and the one before it */
+	map<int, int>::iterator next = spByFirst.lower_bound(first);
+	map<int, int>::iterator prev = (next == spByFirst.begin()) ? spByFirst.end() : next;
+	--prev;
+	if (next == spByFirst.end())
+		next = spByFirst.begin();
+	return spOverlap(first, span, next->second) || spOverlap(first, span, prev->second);
+}
 
-		if (fabs(currLen - lastLen) < 1e-2) {
-			contCnt += 1;
-			if (contCnt >= MAXLAST) {
-				//printf("unchanged for %d times1!\n", contCnt);
-				break;
+/* phase 2, run by one thread: pick the moves of this round, then step the temperature */
+void spCommit() {
+	int N = distN;
+	if (spChain.sinceSync >= SA_RESYNC) {
+		spChain.len = tourLen(spChain.tour);	// the last round is applied
+		spChain.sinceSync = 0;
+	}
+	spCnt = 0;
+	spByFirst.clear();
+	for (int t = 0; t < nprocess; ++t) {
+		SpThread &s = spThr[t];
+		spAccepted += s.cnt;
+		for (int k = 0; k < s.cnt; ++k) {
+			int p = s.p[k], q = s.q[k], len = q - p + 1;
+			int first = p - 1, span = len + 2;
+			if (2 * len > N) {		// the complement q+1 .. p-1 gets reversed
+				first = q;
+				span = N - len + 2;
 			}
+			first = (first + N) % N;
+			if (spConflict(first, span))
+				continue;
+			spByFirst[first] = spCnt;
+			spP[spCnt] = p;
+			spQ[spCnt] = q;
+			spFirst[spCnt] = first;
+			spSpan[spCnt] = span;
+			spCnt++;
+			spChain.len += s.delta[k];
+			spChain.sinceSync++;
 		}
-		else
-			contCnt = 0;
-		lastLen = currLen;
 	}
-	
-	return;
+	spCommitted += spCnt;
+	if (++spRound < spRounds)
+		return;
+	/* end of a temperature step, as in saRunSteps() */
+	spRound = 0;
+	if (fabs(spChain.len - spLastLen) < SAMELEN)
+		spDone = (++spSame >= MAXLAST);
+	else
+		spSame = 0;
+	spLastLen = spChain.len;
+	if (spTemp <= STOPTEMP)
+		spDone = true;
+	else
+		spTemp *= ALPHA;
 }
 
-void *routine(void *idx) {
+void *spRoutine(void *idx) {
 	long tid = (long)idx;
-	int *localMin = (int *)malloc(sizeof(int) * N);
-	int *tour = currTour[tid];
-    memcpy(localMin, tour, sizeof(int) * N);
-	float localMinDist = -1;
-	int localIter = -1;
-	for (int i = 0; i < MAXITER; ++i) {
-		pthread_mutex_lock(&mutex);
-		globalIter++;
-		localIter = globalIter;
-		pthread_mutex_unlock(&mutex);
-		if (localIter >= MAXITER) {
+	pinSelf(tid);
+	numaBindThread();
+	SpThread &s = spThr[tid];
+	s.p = (int *)spArena[tid].alloc(sizeof(int) * spBatch);
+	s.q = (int *)spArena[tid].alloc(sizeof(int) * spBatch);
+	s.delta = (float *)spArena[tid].alloc(sizeof(float) * spBatch);
+	int *tour = spChain.tour, *pos = spChain.pos;
+	Metropolis metro(spTemp);
+	while (true) {
+		if (metro.temperature != spTemp)
+			metro.init(spTemp);
+		/* phase 1: speculate on the frozen tour */
+		s.cnt = 0;
+		for (int b = 0; b < spBatch; ++b) {
+			int p, q;
+			if (pos != NULL)
+				candidateBlock(tour, pos, N, s.rng, p, q);
+			else
+				randomBlock(N, s.rng, p, q);
+			float delta = reverseDelta(tour, N, p, q);
+			if (saAccept(delta, metro, s.rng)) {
+				s.p[s.cnt] = p;
+				s.q[s.cnt] = q;
+				s.delta[s.cnt] = delta;
+				s.cnt++;
+			}
+		}
+		if (pthread_barrier_wait(&spBarrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+			spCommit();
+		pthread_barrier_wait(&spBarrier);
+		/* phase 3: the committed moves touch disjoint positions */
+		for (int c = tid; c < spCnt; c += nprocess)
+			applyReverse(tour, pos, N, spP[c], spQ[c]);
+		pthread_barrier_wait(&spBarrier);
+		if (spDone)
 			break;
+	}
+	return NULL;
+}
+
+/* one shared tour annealed by nprocess threads, the result ends up in minTour */
+void spRun() {
+	spBatch = optionInt("spbatch", SP_BATCH);
+	if (spBatch < 1 || tourMode != TOUR_ARRAY) {
+		fprintf(stderr, "Bad shared tour options: --spbatch=B >= 1, --tour=array\n");
+		exit(1);
+	}
+	spRounds = RELAX / (spBatch * nprocess);
+	if (spRounds < 1)
+		spRounds = 1;
+	printf("Shared tour: %d threads x %d proposals per round, %d rounds per temperature\n", nprocess, spBatch, spRounds);
+	Rng rng(rngSeed, 0);
+	int *tour = (int *)malloc(sizeof(int) * N);
+	float t0 = buildTour(tour, rng) ? saStartTemp(tour, rng) : INITEMP;
+	chainInit(spChain, tour);
+	spTemp = t0 * ALPHA;
+	spLastLen = spChain.len;
+	spThr = new SpThread[nprocess];
+	spArena = new Arena[nprocess];
+	for (int i = 0; i < nprocess; ++i)
+		spThr[i].rng.seed(rngSeed, 1 + i);
+	int most = nprocess * spBatch;
+	spP = (int *)malloc(sizeof(int) * most);
+	spQ = (int *)malloc(sizeof(int) * most);
+	spFirst = (int *)malloc(sizeof(int) * most);
+	spSpan = (int *)malloc(sizeof(int) * most);
+	pthread_barrier_init(&spBarrier, NULL, nprocess);
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * nprocess);
+	for (long i = 0; i < nprocess; ++i) {
+		if (pthread_create(&threads[i], NULL, spRoutine, (void *)i)) {
+			fprintf(stderr, "Fail to create thread! %ld\n", i);
+			exit(1);
 		}
-		unsigned int s = time(0);
-		pthread_mutex_lock(&mutex2);
-		random_shuffle((int *)tour, (int *)tour + N);
-		pthread_mutex_unlock(&mutex2);
-		saTSP((int *)tour);
-		int len = tourLen(tour);
-		if ((len < localMinDist) || (localMinDist < 0)) {
-			localMinDist = len;
-			memcpy(localMin, tour, sizeof(int) * N);
+	}
+	for (int i = 0; i < nprocess; ++i) {
+		if (pthread_join(threads[i], NULL)) {
+			fprintf(stderr, "Fail to join thread!\n");
+			exit(1);
 		}
 	}
-	memcpy(tour, localMin, sizeof(int) * N);
-	free(localMin);
-	return NULL;
+	printf("Moves committed: %lld of %lld accepted (the rest conflicted)\n", spCommitted, spAccepted);
+	chainFree(spChain);
+	memcpy(minTour, tour, sizeof(int) * N);
+	minTourDist = tourLen(minTour);
+	pthread_barrier_destroy(&spBarrier);
+	free(threads);
+	free(tour);
+	free(spP);
+	free(spQ);
+	free(spFirst);
+	free(spSpan);
+	spByFirst.clear();
+	delete[] spThr;
+	delete[] spArena;
+}
+
+void waitPool(TaskPool &pool) {
+	pool.wait();
+}
+
+/*
+	MAXITER independent anneals (or a --race, or a --population) on a
+	pool of nprocess threads, the best tour ends up in minTour
+*/
+void multiStart() {
+	TaskPool pool;
+	pool.init(nprocess);
+	pool.start();
+	int population = optionInt("population", 0);
+	if (population > 0) {
+		minTourDist = populationAnneal(pool, population, waitPool, minTour);
+		pool.stop();
+		return;
+	}
+	int race = optionInt("race", 0);
+	int cnt = (race > 0) ? race : MAXITER;
+	RestartTask *rs;
+	if (race > 0)
+		rs = raceRestarts(pool, race, waitPool);
+	else {
+		rs = submitRestarts(pool, MAXITER);
+		pool.wait();
+	}
+	pool.stop();
+	minTourDist = bestRestart(rs, cnt, minTour);
+	printf("Hopeless restarts: %d / %d\n", (int)abandoned, cnt);
 }
 
 int main(int argc, char **argv) {
+	argc = parseOptions(argc, argv);
 	if (argc < 2) {
 		printf("Please enter the filename!\n");
 		return 0;
@@ -235,52 +419,32 @@ int main(int argc, char **argv) {
 	else {
 		loadFile(argv[1]);
 	}
+	initNuma();
+	initPinning();
+	initAnneal();
+	initConstruct("random");
+	bool pt = (optionValue("pt", NULL) != NULL);
+	bool shared = (optionValue("shared", NULL) != NULL);
+	bool population = (optionValue("population", NULL) != NULL);
+	int race = optionInt("race", 0);
+	int restarts = (race > 0) ? race : MAXITER;		// more threads would sit idle
 	if (argc > 2) {
 		nprocess = atoi(argv[2]);
-		if (nprocess > MAXITER) {
-			nprocess = MAXITER;
+		if (!pt && !shared && !population && nprocess > restarts) {
+			nprocess = restarts;
 		}
 	}
-	printf("MaxIter=%d, Processor=%d, %s \n", MAXITER, nprocess, argv[1]);
+	initRng();
+	printf("MaxIter=%d, Processor=%d, Seed=%llu, %s \n", MAXITER, nprocess, (unsigned long long)rngSeed, argv[1]);
 	struct timeval start, stop;
 	gettimeofday(&start, NULL);
 	minTour = (int *)malloc(sizeof(int) * N);
-	pthread_mutex_init(&mutex, NULL);
-	pthread_mutex_init(&mutex2, NULL);
-	srandom(time(0));
-	/* create "nprocess" threads and work! */
-	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * nprocess);
-    for (int i = 0; i < nprocess; ++i) {
-		currTour[i] = (int *)malloc(sizeof(int) * N);
-		for (int j = 0; j < N; ++j)
-			currTour[i][j] = j;
-		if (pthread_create(&threads[i], NULL, routine, (void *)i)) {
-			fprintf(stderr, "Fail to create thread! %d\n", i);
-			exit(1);
-		}
-	}
-
-	/* join all the threads */
-	void *status;
-	for (int i = 0; i < nprocess; ++i) {
-		if (pthread_join(threads[i], &status)) {
-			fprintf(stderr, "Fail to create thread!\n");
-			exit(1);
-		}
-		currLen[i] = tourLen(currTour[i]);
-	}
-	
-	/* find the minimal answer */
-	int minidx = 0;
-	for (int i = 0; i < nprocess; ++i) {
-		if ((currLen[i] < minTourDist) || (minTourDist < 0)) {
-			minTourDist = currLen[i];
-			minidx = i;
-		}
-	}
-	for (int i = 0; i < N; ++i) {
-		minTour[i] = currTour[minidx][i];
-	}
+	if (pt)
+		ptRun();
+	else if (shared)
+		spRun();
+	else
+		multiStart();
 	gettimeofday(&stop, NULL);
 
 	// ------------- Print the result! -----------------
@@ -290,10 +454,6 @@ int main(int argc, char **argv) {
 	printf("Total time usage: %.3lf sec. \n", tottime);
 	printf("The shortest length is: %f\n\n", minTourDist);
 	free(minTour);
-	for (int i = 0; i < nprocess; ++i)
-		free(currTour[i]);
-    free(threads);
-	pthread_mutex_destroy(&mutex);
-	pthread_mutex_destroy(&mutex2);
+	freeNuma();
 	return 0;
 }
@@ -0,0 +1,1019 @@
+#ifndef UTILS_ANNEAL_HPP_
+#define UTILS_ANNEAL_HPP_
+
+/*
+	Simulated annealing kernel shared by the SA drivers
+	(baseline/SA_TSP.cpp, parallel/SA_TSP.cpp, parallel/omp_SA_TSP.cpp,
+	parallel/pthread_SA_TSP.cpp)
+
+	The constants below can be overridden by defining them before this
+	file is included (or with -D on the command line).
+
+	Tour lengths are kept incrementally: every accepted move adds its
+	delta to a double, and every SA_RESYNC accepted moves the length is
+	recomputed to drop the rounding drift (the relax functions take and
+	return the count since the last re-sync). Build with -DSA_CHECK_DRIFT
+	to print the largest drift seen at exit.
+
+	Every proposal draws r in [0, 1) and picks a move (utils/moves.hpp):
+	  r < THRESH1              node swap
+	  THRESH1 <= r < THRESH2   block reverse (2-opt)
+	  THRESH2 <= r < THRESH3   Or-opt, a segment of 1-3 cities
+	  THRESH3 <= r             segment insertion, 4..SEGMAX cities
+
+	Options:
+	  --tour=array|twolevel
+	               tour representation (utils/tour.hpp): array runs
+	               saRelax() on the int array, twolevel runs saRelaxTour()
+	               on a two-level doubly-linked list, O(sqrt(N)) per 2-opt
+	  --cand=K     propose moves only between a city and one of its K
+	               nearest neighbors (0, the default, picks p and q uniformly)
+	  --pswap=P, --poropt=P, --pinsert=P
+	               move probabilities, 2-opt gets the rest
+	               (default THRESH1, THRESH3-THRESH2, 1-THRESH3)
+	  --initscale=F
+	               a run from a constructed start tour (utils/construct.hpp)
+	               starts at F (default 1) times the temperature that
+	               saStartTemp() estimates for that tour
+	  --batch=B, --batchpick=first|best
+	               array tours evaluate up to B (<= BATCH_MAX) consecutive
+	               2-opt proposals at once (utils/batch.hpp). Every
+	               proposal still draws its own move type, a batch ends
+	               at the first other one. first (the default) applies
+	               the first accepted proposal and drops the rest of the
+	               batch unseen, so the chain is the one-at-a-time chain
+	               with other random numbers; best evaluates the whole
+	               batch and applies the accepted move with the smallest
+	               delta, greedier. The batch runs the log form of the
+	               Metropolis test whatever SA_ACCEPT_* says.
+	  --prefetch=D array tours draw 2-opt proposals D (<= PIPE_MAX)
+	               ahead into a ring (SaPipe below) and prefetch the tour
+	               slots, and later the distances, they will read. Any
+	               accepted move empties the ring. Meant for matrices
+	               well beyond the last level cache, off (0) by default.
+	  --interleave=K|auto
+	               the pooled drivers (utils/restarts.hpp) advance K
+	               restarts together on one thread, one proposal of each
+	               in turn (saRunGroupStep() below), so the cache misses
+	               of one chain overlap the others' work. auto picks K
+	               from a measured miss latency and proposal cost
+	               (saCalibrateInterleave()). 1, the default, runs one
+	               restart at a time; otherwise --prefetch is at least 2.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+#include "options.hpp"
+#include "distance.hpp"
+#include "neighbors.hpp"
+#include "moves.hpp"
+#include "tour.hpp"
+#include "rng.hpp"
+#include "arena.hpp"
+#include "batch.hpp"
+
+#ifndef THRESH1
+	#define THRESH1 0.1		// Threshold 1 for the strategy
+#endif
+#ifndef THRESH2
+	#define THRESH2 0.89	// Threshold 2 for the strategy
+#endif
+#ifndef THRESH3
+	#define THRESH3 0.95	// Threshold 3 for the strategy
+#endif
+#ifndef RELAX
+	#define RELAX 40000		// The times of relaxation of the same temperature
+#endif
+#ifndef ALPHA
+	#define ALPHA 0.999		// Cooling rate
+#endif
+#ifndef INITEMP
+	#define INITEMP 99.0	// Initial temperature
+#endif
+#ifndef STOPTEMP
+	#define STOPTEMP 0.001	// Termination temperature
+#endif
+#ifndef MAXLAST
+	#define MAXLAST 3		// Stop if the tour length keeps unchanged for MAXLAST consecutive temperature
+#endif
+#ifndef SAMELEN
+	#define SAMELEN 1e-3	// Two lengths closer than this count as unchanged
+#endif
+#ifndef SA_RESYNC
+	#define SA_RESYNC 10000	// Recompute the tour length after this many accepted moves
+#endif
+#define PIPE_MAX 16			// Deepest --prefetch
+#ifndef INTERLEAVE_MAX
+	#define INTERLEAVE_MAX 16	// Most chains per thread with --interleave
+#endif
+
+float moveCut[3] = { THRESH1, THRESH2, THRESH3 };	// cumulative swap / 2-opt / Or-opt cuts
+int tourMode = TOUR_ARRAY;		// --tour
+bool distIntegral = false;		// every distance is a whole number (SA_ACCEPT_TABLE)
+float initScale = 1;			// --initscale
+int saBatch = 1;				// --batch, 1: one proposal at a time
+bool saBatchBest = false;		// --batchpick=best
+int saPrefetch = 0;				// --prefetch, pipeline depth
+int saInterleave = 1;			// --interleave, chains per thread, 0: auto
+#ifdef SA_CHECK_DRIFT
+std::atomic<double> saMaxDrift(0);	// largest |incremental - recomputed| length
+
+void saReportDrift() {
+	printf("Max tour length drift: %g\n", (double)saMaxDrift);
+}
+#endif
+
+/* read the annealing options, call after the instance is loaded */
+void initAnneal() {
+	tourMode = parseTourMode(optionValue("tour", "array"));
+	int k = optionInt("cand", 0);
+	if (k > 0)
+		buildNeighbors(k);
+	double pSwap = optionDouble("pswap", THRESH1);
+	double pOrOpt = optionDouble("poropt", THRESH3 - THRESH2);
+	double pInsert = optionDouble("pinsert", 1.0 - THRESH3);
+	if (pSwap < 0 || pOrOpt < 0 || pInsert < 0 || pSwap + pOrOpt + pInsert > 1) {
+		fprintf(stderr, "Bad move probabilities!\n");
+		exit(1);
+	}
+	initScale = optionDouble("initscale", 1);
+	if (initScale <= 0) {
+		fprintf(stderr, "Bad start temperature scale: %g\n", initScale);
+		exit(1);
+	}
+	saBatch = optionInt("batch", 1);
+	const char *pick = optionValue("batchpick", "first");
+	saBatchBest = (strcmp(pick, "best") == 0);
+	if (saBatch < 1 || saBatch > BATCH_MAX || (!saBatchBest && strcmp(pick, "first") != 0)) {
+		fprintf(stderr, "Bad batch options: --batch=1..%d --batchpick=first|best\n", BATCH_MAX);
+		exit(1);
+	}
+	saPrefetch = optionInt("prefetch", 0);
+	if (saPrefetch < 0 || saPrefetch > PIPE_MAX) {
+		fprintf(stderr, "Bad prefetch depth: --prefetch=0..%d\n", PIPE_MAX);
+		exit(1);
+	}
+	const char *il = optionValue("interleave", "1");
+	saInterleave = (strcmp(il, "auto") == 0) ? 0 : atoi(il);
+	if (saInterleave < 0 || saInterleave > INTERLEAVE_MAX || (saInterleave == 0 && strcmp(il, "auto") != 0)) {
+		fprintf(stderr, "Bad interleave: --interleave=1..%d|auto\n", INTERLEAVE_MAX);
+		exit(1);
+	}
+	if (saInterleave != 1 && saPrefetch < 2)
+		saPrefetch = 2;		// a run's proposals must not depend on its group
+	if (distN < 8)
+		pSwap = pOrOpt = pInsert = 0;	// too small for the segment moves
+#ifdef SA_ACCEPT_TABLE
+	distIntegral = distWholeNumbers();
+#endif
+	/* r < moveCut[0]: swap, < moveCut[1]: 2-opt, < moveCut[2]: Or-opt, else insertion */
+	moveCut[0] = pSwap;
+	moveCut[1] = 1.0 - pOrOpt - pInsert;
+	moveCut[2] = 1.0 - pInsert;
+#ifdef SA_CHECK_DRIFT
+	atexit(saReportDrift);
+#endif
+}
+
+/* Calculate the length of the tour */
+double tourLen(int *tour) {
+	if (tour == NULL) {
+		printf("tour not exist!\n");
+		return -1;
+	}
+	int N = distN;
+	double cnt = 0;
+	for (int i = 0; i < N - 1; ++i) {
+		cnt += getDist(tour[i], tour[i+1]);
+	}
+	cnt += getDist(tour[N-1], tour[0]);
+	return cnt;
+}
+
+/* Calculate the length of a tour/tour.hpp tour */
+template<class TourT>
+double tourLen(const TourT &t) {
+	double cnt = 0;
+	int c = 0;
+	for (int i = 0; i < distN; ++i) {
+		int nc = t.next(c);
+		cnt += getDist(c, nc);
+		c = nc;
+	}
+	return cnt;
+}
+
+/* uniform block [p, q] to reverse, p < q */
+inline void randomBlock(int N, Rng &rng, int &p, int &q) {
+	p = rng.bounded(N), q = rng.bounded(N);
+	// If will occur error if p=0 q=N-1...
+	if (abs(p - q) == N-1) {
+		q = rng.bounded(N-1);
+		p = rng.bounded(N-2);
+	}
+	if (p == q) {
+		q = (q + 2) % N;
+	}
+	if (p > q) {
+		int tmp = p;
+		p = q;
+		q = tmp;
+	}
+}
+
+/*
+	block [p, q] whose reversal makes a random city a = tour[i] adjacent
+	to one of its candidates c = tour[j]: either the new edges are
+	(a, c) + (succ a, succ c) or (pred a, pred c) + (a, c). The block
+	never wraps around and never covers the whole tour.
+*/
+inline void candidateBlock(const int *tour, const int *pos, int N, Rng &rng, int &p, int &q) {
+	int i = rng.bounded(N);
+	int a = tour[i];
+	int j = pos[candList[a * candK + rng.bounded(candK)]];
+	if (rng.next32() & 1) {
+		p = (i < j ? i : j) + 1;
+		q = (i < j ? j : i);
+	}
+	else {
+		p = (i < j ? i : j);
+		q = (i < j ? j : i) - 1;
+	}
+}
+
+/* node swap proposal: positions i != j; with candidates a neighbor of tour[i] moves next to it */
+inline void swapProposal(const int *tour, const int *pos, int N, Rng &rng, int &i, int &j) {
+	i = rng.bounded(N);
+	if (pos != NULL) {
+		j = pos[candList[tour[i] * candK + rng.bounded(candK)]];
+		i = (i + 1) % N;
+		if (j != i)
+			return;
+	}
+	j = (i + 1 + rng.bounded(N-1)) % N;
+}
+
+/* segment move proposal: L cities from position i go after position k, k outside [i-1, i+L-1] */
+inline void segmentProposal(const int *tour, const int *pos, int N, int L, Rng &rng, int &i, int &k) {
+	i = rng.bounded(N);
+	if (pos != NULL) {
+		/* next to a neighbor of the first city of the segment, before or after it */
+		k = pos[candList[tour[i] * candK + rng.bounded(candK)]] - (int)(rng.next32() & 1);
+		if (k < 0)
+			k += N;
+		int rk = (k - i + N) % N;
+		if (rk >= L && rk <= N - 2)
+			return;
+	}
+	k = (i + L + rng.bounded(N-1-L)) % N;
+}
+
+/*
+	Metropolis criterion: downhill moves are accepted, uphill ones with
+	probability exp(-delta/T). Selected at build time:
+
+	  default            exp(-delta/T) > u
+	  -DSA_ACCEPT_LOG    delta < -T*ln(u) with fastLog(), no libm call
+	  -DSA_ACCEPT_TABLE  integral instances (e.g. gr17, fri26): prob[d] =
+	                     exp(-d/T) for integer deltas d < ACCEPT_TABLE,
+	                     built once per temperature, anything else goes
+	                     through the log test
+
+	u is uniform in (0, 1] in the log and table tests.
+*/
+#ifndef ACCEPT_TABLE
+	#define ACCEPT_TABLE 4096	// Largest integer delta with a table entry
+#endif
+
+/* the acceptance test at one temperature */
+struct Metropolis {
+	float temperature;
+#ifdef SA_ACCEPT_TABLE
+	int tabN;					// prob[] entries in use, deltas >= tabN are never accepted...
+	bool tabAll;				// ...unless the table was capped at ACCEPT_TABLE
+	float prob[ACCEPT_TABLE];
+#endif
+
+	Metropolis() {
+	}
+
+	Metropolis(float T) {
+		init(T);
+	}
+
+	void init(float T) {
+		temperature = T;
+#ifdef SA_ACCEPT_TABLE
+		tabN = 0;
+		tabAll = true;
+		if (distIntegral) {
+			/* exp(-d/T) < 2^-24 <= u beyond this */
+			double cut = T * 24 * log(2.0) + 2;
+			tabN = (cut < ACCEPT_TABLE) ? (int)cut : ACCEPT_TABLE;
+			tabAll = (cut < ACCEPT_TABLE);
+			for (int d = 0; d < tabN; ++d)
+				prob[d] = exp(-d / T);
+		}
+#endif
+	}
+};
+
+inline bool saAccept(float delta, const Metropolis &m, Rng &rng) {
+	if (delta < 0)
+		return true;
+	if (!(delta > 0))
+		return false;
+#if defined(SA_ACCEPT_LOG) || defined(SA_ACCEPT_TABLE)
+	float u = rng.uniformOpen();
+  #ifdef SA_ACCEPT_TABLE
+	int d = (int)delta;
+	if (m.tabN > 0 && d == delta) {
+		if (d < m.tabN)
+			return m.prob[d] > u;
+		if (m.tabAll)
+			return false;
+	}
+  #endif
+	return delta < -m.temperature * fastLog(u);
+#else
+	return exp(-delta/m.temperature) > rng.uniform();
+#endif
+}
+
+/* recompute currLen from the tour t */
+template<class TourT>
+void saResync(const TourT &t, double &currLen) {
+	double len = tourLen(t);
+#ifdef SA_CHECK_DRIFT
+	double drift = fabs(currLen - len);
+	double seen = saMaxDrift;
+	while (drift > seen && !saMaxDrift.compare_exchange_weak(seen, drift))
+		;
+#endif
+	currLen = len;
+}
+
+/* currLen after an accepted move on t, sinceSync counts the moves since the last re-sync */
+template<class TourT>
+inline void saUpdateLen(const TourT &t, double &currLen, float delta, int &sinceSync) {
+	currLen += delta;
+	if (++sinceSync >= SA_RESYNC) {
+		sinceSync = 0;
+		saResync(t, currLen);
+	}
+}
+
+/*
+	start temperature for a constructed tour: the temperature at which
+	the tour looks like an equilibrium state, i.e. one Metropolis step
+	leaves the expected length unchanged,
+	  sum over sampled proposals of min(1, exp(-delta/T)) * delta = 0,
+	found by bisection, times --initscale, at most INITEMP
+*/
+float saStartTemp(int *tour, Rng &rng) {
+	const int samples = 2000;
+	int N = distN;
+	int *pos = NULL;
+	if (candK > 0) {
+		pos = (int *)malloc(sizeof(int) * N);
+		for (int i = 0; i < N; ++i)
+			pos[tour[i]] = i;
+	}
+	float *delta = (float *)malloc(sizeof(float) * samples);
+	for (int i = 0; i < samples; ++i) {
+		int p, q;
+		if (pos != NULL)
+			candidateBlock(tour, pos, N, rng, p, q);
+		else
+			randomBlock(N, rng, p, q);
+		delta[i] = reverseDelta(tour, N, p, q);
+	}
+	free(pos);
+	float lo = 0, hi = INITEMP;
+	for (int it = 0; it < 40; ++it) {
+		float t = (lo + hi) / 2;
+		double drift = 0;
+		for (int i = 0; i < samples; ++i)
+			drift += (delta[i] > 0) ? delta[i] * exp(-delta[i] / t) : delta[i];
+		if (drift > 0)
+			hi = t;
+		else
+			lo = t;
+	}
+	free(delta);
+	float t = hi * initScale;
+	return (t < INITEMP) ? t : INITEMP;
+}
+
+/*
+	2-opt proposals drawn ahead of time (--prefetch=D): a new proposal
+	enters the ring D proposals before it is evaluated, and its four tour
+	slots are prefetched; D/2 proposals later the slots have arrived and
+	the four distances between their cities are prefetched. An accepted
+	move changes the cities (and pos[]) the queued proposals were drawn
+	from, so it flushes the ring.
+*/
+struct SaPipe {
+	int depth;
+	int head, cnt;			// oldest entry, entries queued
+	int p[PIPE_MAX], q[PIPE_MAX];
+};
+
+template<class D>
+inline void pipePush(const D &dist, SaPipe &s, const int *tour, const int *pos, int N, Rng &rng) {
+	int t = (s.head + s.cnt) % PIPE_MAX;
+	if (pos != NULL)
+		candidateBlock(tour, pos, N, rng, s.p[t], s.q[t]);
+	else
+		randomBlock(N, rng, s.p[t], s.q[t]);
+	int p = s.p[t], q = s.q[t];
+	__builtin_prefetch(&tour[p == 0 ? N - 1 : p - 1]);
+	__builtin_prefetch(&tour[p]);
+	__builtin_prefetch(&tour[q]);
+	__builtin_prefetch(&tour[q + 1 == N ? 0 : q + 1]);
+	s.cnt++;
+	if (s.cnt > s.depth / 2) {
+		int m = (t + PIPE_MAX - s.depth / 2) % PIPE_MAX;
+		p = s.p[m];
+		q = s.q[m];
+		int tp = tour[p], tq = tour[q];
+		int tp1 = tour[p == 0 ? N - 1 : p - 1], tq1 = tour[q + 1 == N ? 0 : q + 1];
+		dist.prefetch(tp, tq1);
+		dist.prefetch(tp1, tq);
+		dist.prefetch(tp, tp1);
+		dist.prefetch(tq, tq1);
+	}
+}
+
+/* the next proposal [p, q], the ring is kept depth deep */
+template<class D>
+inline void pipeNext(const D &dist, SaPipe &s, const int *tour, const int *pos, int N, Rng &rng, int &p, int &q) {
+	while (s.cnt < s.depth)
+		pipePush(dist, s, tour, pos, N, rng);
+	p = s.p[s.head];
+	q = s.q[s.head];
+	s.head = (s.head + 1) % PIPE_MAX;
+	s.cnt--;
+}
+
+/* saRelax() between two proposals, so a chain can be advanced one proposal at a time */
+struct SaRelaxer {
+	Metropolis metro;
+	int N, segMax;
+	bool multiMove;
+	int pending;			// move type drawn by the last batch for the next proposal
+	SaPipe pipe;
+
+	void init(float temperature, int depth) {
+		metro.init(temperature);
+		N = distN;
+		segMax = (N / 2 < SEGMAX) ? N / 2 : SEGMAX;
+		multiMove = (moveCut[0] > 0) || (moveCut[1] < 1);
+		pending = -1;
+		pipe.depth = depth;
+		pipe.head = pipe.cnt = 0;
+	}
+};
+
+/* the next proposal (a whole batch with --batch), returns how many of the left ones it used */
+template<class D>
+inline __attribute__((always_inline)) int saPropose(const D &dist, SaRelaxer &s, int *tour, int *pos, double &currLen, Rng &rng, int &sinceSync, int left) {
+	int N = s.N;
+	/* generate a random r to determine the proposal */
+	int move = 1;
+	if (s.pending >= 0) {
+		move = s.pending;
+		s.pending = -1;
+	}
+	else if (s.multiMove) {
+		float r = rng.uniform();
+		move = (r < moveCut[0]) ? 0 : (r < moveCut[1]) ? 1 : (r < moveCut[2]) ? 2 : 3;
+	}
+	if (move == 1 && saBatch > 1) {
+		/* Proposal 1, batched: the run of consecutive block reverses */
+		int bp[BATCH_MAX], bq[BATCH_MAX], cnt = 0;
+		float bd[BATCH_MAX];
+		while (true) {
+			if (pos != NULL)
+				candidateBlock(tour, pos, N, rng, bp[cnt], bq[cnt]);
+			else
+				randomBlock(N, rng, bp[cnt], bq[cnt]);
+			if (++cnt == saBatch || cnt == left)
+				break;
+			if (s.multiMove) {
+				float r = rng.uniform();
+				int m = (r < moveCut[0]) ? 0 : (r < moveCut[1]) ? 1 : (r < moveCut[2]) ? 2 : 3;
+				if (m != 1) {
+					s.pending = m;
+					break;
+				}
+			}
+		}
+		float bu[BATCH_MAX];
+		for (int l = 0; l < cnt; ++l)
+			bu[l] = rng.uniformOpen();
+		batchReverseDelta(dist, tour, N, bp, bq, cnt, bd);
+		unsigned acc = batchAccept(bd, bu, cnt, s.metro.temperature);
+		int pick = -1, used = cnt;
+		if (acc != 0 && !saBatchBest) {
+			pick = __builtin_ctz(acc);
+			used = pick + 1;
+		}
+		for (int l = 0; acc != 0 && saBatchBest && l < cnt; ++l) {
+			if (((acc >> l) & 1) && (pick < 0 || bd[l] < bd[pick]))
+				pick = l;
+		}
+		if (pick >= 0) {
+			applyReverse(tour, pos, N, bp[pick], bq[pick]);
+			saUpdateLen(tour, currLen, bd[pick], sinceSync);
+		}
+		return used;
+	}
+	int p, q, L = 0;
+	bool rev = false;
+	float delta;
+	if (move == 1) {
+		/* Proposal 1: Block Reverse between p and q */
+		if (s.pipe.depth > 0)
+			pipeNext(dist, s.pipe, tour, pos, N, rng, p, q);
+		else if (pos != NULL)
+			candidateBlock(tour, pos, N, rng, p, q);
+		else
+			randomBlock(N, rng, p, q);
+		delta = reverseDelta(dist, tour, N, p, q);
+	}
+	else if (move == 0) {
+		/* Proposal 2: swap the cities at p and q */
+		swapProposal(tour, pos, N, rng, p, q);
+		delta = swapDelta(dist, tour, N, p, q);
+	}
+	else {
+		/* Proposal 3: move L cities from p to after q (Or-opt or segment insertion) */
+		L = (move == 2) ? 1 + rng.bounded(3) : 4 + rng.bounded(s.segMax-3);
+		segmentProposal(tour, pos, N, L, rng, p, q);
+		delta = segmentDelta(dist, tour, N, p, L, q, rev);
+	}
+
+	/* whether to accept the change */
+	if (saAccept(delta, s.metro, rng)) {
+		if (move == 1)
+			applyReverse(tour, pos, N, p, q);
+		else if (move == 0)
+			applySwap(tour, pos, p, q);
+		else
+			applySegment(tour, pos, N, p, L, q, rev);
+		saUpdateLen(tour, currLen, delta, sinceSync);
+		s.pipe.head = s.pipe.cnt = 0;
+	}
+	return 1;
+}
+
+template<class D>
+int saRelaxWith(const D &dist, int *tour, int *pos, float temperature, double &currLen, Rng &rng, int sinceSync) {
+	SaRelaxer s;
+	s.init(temperature, saPrefetch);
+	for (int i = 0; i < RELAX; )
+		i += saPropose(dist, s, tour, pos, currLen, rng, sinceSync, RELAX - i);
+	return sinceSync;
+}
+
+/*
+	RELAX proposals at a fixed temperature, pos[] is NULL unless candK > 0,
+	returns the accepted moves since the last length re-sync
+*/
+int saRelax(int *tour, int *pos, float temperature, double &currLen, Rng &rng, int sinceSync = 0) {
+	switch (distBackend()) {
+		case DB_DENSE_U16:
+			return saRelaxWith(DistView<DB_DENSE_U16>(), tour, pos, temperature, currLen, rng, sinceSync);
+		case DB_PACKED:
+			return saRelaxWith(DistView<DB_PACKED>(), tour, pos, temperature, currLen, rng, sinceSync);
+		case DB_PACKED_U16:
+			return saRelaxWith(DistView<DB_PACKED_U16>(), tour, pos, temperature, currLen, rng, sinceSync);
+		case DB_COORD:
+			return saRelaxWith(DistView<DB_COORD>(), tour, pos, temperature, currLen, rng, sinceSync);
+		default:
+			return saRelaxWith(DistView<DB_DENSE>(), tour, pos, temperature, currLen, rng, sinceSync);
+	}
+}
+
+/*
+	saRelax() on a utils/tour.hpp tour, by city instead of by position:
+	the same moves and probabilities, each applied as one to three
+	2-opt flips.
+*/
+template<class TourT, class D>
+int saRelaxTourWith(const D &dist, TourT &t, float temperature, double &currLen, Rng &rng, int sinceSync) {
+	int N = distN;
+	bool multiMove = (moveCut[0] > 0) || (moveCut[1] < 1);
+	int segMax = (N / 2 < SEGMAX) ? N / 2 : SEGMAX;
+	Metropolis metro(temperature);
+	for (int i = 0; i < RELAX; ++i) {
+		int move = 1;
+		if (multiMove) {
+			float r = rng.uniform();
+			move = (r < moveCut[0]) ? 0 : (r < moveCut[1]) ? 1 : (r < moveCut[2]) ? 2 : 3;
+		}
+		if (move == 1) {
+			/* 2-opt: (a, b) + (c, d) -> (a, c) + (b, d), c a candidate of a */
+			int a = rng.bounded(N), b, c, d;
+			c = (candK > 0) ? candList[a * candK + rng.bounded(candK)] : rng.bounded(N);
+			if (candK > 0 && (rng.next32() & 1)) {
+				b = t.prev(a);
+				d = t.prev(c);
+			}
+			else {
+				b = t.next(a);
+				d = t.next(c);
+			}
+			if (c == a || c == b || d == a)
+				continue;
+			float delta = dist(a, c) + dist(b, d) - dist(a, b) - dist(c, d);
+			if (saAccept(delta, metro, rng)) {
+				make2opt(t, a, b, c, d);
+				saUpdateLen(t, currLen, delta, sinceSync);
+			}
+		}
+		else if (move == 0) {
+			/* swap u and v; with candidates v is a neighbor of prev(u) */
+			int u = rng.bounded(N), v;
+			if (candK > 0) {
+				v = candList[u * candK + rng.bounded(candK)];
+				u = t.next(u);
+			}
+			else
+				v = rng.bounded(N);
+			if (u == v)
+				continue;
+			if (t.next(v) == u) {
+				int tmp = u;
+				u = v;
+				v = tmp;
+			}
+			int pu = t.prev(u), nu = t.next(u), pv = t.prev(v), nv = t.next(v);
+			float delta;
+			if (nu == v)
+				delta = dist(pu, v) + dist(u, nv) - dist(pu, u) - dist(v, nv);
+			else
+				delta = dist(pu, v) + dist(v, nu) + dist(pv, u) + dist(u, nv)
+					- dist(pu, u) - dist(u, nu) - dist(pv, v) - dist(v, nv);
+			if (saAccept(delta, metro, rng)) {
+				/* pu u nu .. pv v nv -> pu v pv .. nu u nv -> pu v nu .. pv u nv */
+				make2opt(t, pu, u, v, nv);
+				if (nu != v)
+					make2opt(t, v, pv, nu, u);
+				saUpdateLen(t, currLen, delta, sinceSync);
+			}
+		}
+		else {
+			/* move s1..sL between c and d = next(c), c next to a candidate of s1 */
+			int L = (move == 2) ? 1 + rng.bounded(3) : 4 + rng.bounded(segMax-3);
+			int s1 = rng.bounded(N), sL = s1;
+			for (int k = 1; k < L; ++k)
+				sL = t.next(sL);
+			int p = t.prev(s1), nx = t.next(sL), c = -1;
+			if (candK > 0) {
+				c = candList[s1 * candK + rng.bounded(candK)];
+				if (rng.next32() & 1)
+					c = t.prev(c);
+				if (c == p || t.between(s1, c, sL))
+					c = -1;
+			}
+			if (c < 0) {
+				c = rng.bounded(N);
+				if (c == p || t.between(s1, c, sL))
+					continue;
+			}
+			int d = t.next(c);
+			float removed = dist(p, nx) - dist(p, s1) - dist(sL, nx) - dist(c, d);
+			float fwd = dist(c, s1) + dist(sL, d);
+			float bwd = dist(c, sL) + dist(s1, d);
+			float delta = removed + (bwd < fwd ? bwd : fwd);
+			if (saAccept(delta, metro, rng)) {
+				/* p S nx .. c d -> p c .. nx S' d -> p nx .. c S' d (-> p nx .. c S d) */
+				make2opt(t, p, s1, c, d);
+				make2opt(t, p, c, nx, sL);
+				if (fwd <= bwd)
+					make2opt(t, c, sL, s1, d);
+				saUpdateLen(t, currLen, delta, sinceSync);
+			}
+		}
+	}
+	return sinceSync;
+}
+
+template<class TourT>
+int saRelaxTour(TourT &t, float temperature, double &currLen, Rng &rng, int sinceSync = 0) {
+	switch (distBackend()) {
+		case DB_DENSE_U16:
+			return saRelaxTourWith(DistView<DB_DENSE_U16>(), t, temperature, currLen, rng, sinceSync);
+		case DB_PACKED:
+			return saRelaxTourWith(DistView<DB_PACKED>(), t, temperature, currLen, rng, sinceSync);
+		case DB_PACKED_U16:
+			return saRelaxTourWith(DistView<DB_PACKED_U16>(), t, temperature, currLen, rng, sinceSync);
+		case DB_COORD:
+			return saRelaxTourWith(DistView<DB_COORD>(), t, temperature, currLen, rng, sinceSync);
+		default:
+			return saRelaxTourWith(DistView<DB_DENSE>(), t, temperature, currLen, rng, sinceSync);
+	}
+}
+
+/* one annealing chain on a caller-owned tour, in the representation --tour picked */
+struct SaChain {
+	int *tour;				// the tour, up to date after chainSync()
+	int *pos;				// city -> position in tour, only kept for candidate moves
+	TwoLevelTour *list;		// --tour=twolevel
+	Arena *arena;			// pos came from here, NULL: malloc
+	double len;				// current length
+	int sinceSync;			// accepted moves since len was recomputed
+};
+
+/* rebuild pos / list and the length after c.tour was overwritten */
+void chainReset(SaChain &c) {
+	int N = distN;
+	if (c.list != NULL)
+		c.list->init(c.tour, N);
+	if (c.pos != NULL) {
+		for (int i = 0; i < N; ++i)
+			c.pos[c.tour[i]] = i;
+	}
+	c.len = tourLen(c.tour);
+	c.sinceSync = 0;
+}
+
+/* scratch arrays are taken from arena if one is given */
+void chainInit(SaChain &c, int *tour, Arena *arena = NULL) {
+	int N = distN;
+	c.tour = tour;
+	c.pos = NULL;
+	c.list = NULL;
+	c.arena = arena;
+	if (tourMode == TOUR_TWOLEVEL)
+		c.list = new TwoLevelTour;
+	else if (candK > 0)
+		c.pos = (int *)(arena != NULL ? arena->alloc(sizeof(int) * N) : malloc(sizeof(int) * N));
+	chainReset(c);
+}
+
+/* stay in the same temperature for RELAX times */
+inline void chainRelax(SaChain &c, float temperature, Rng &rng) {
+	if (c.list != NULL)
+		c.sinceSync = saRelaxTour(*c.list, temperature, c.len, rng, c.sinceSync);
+	else
+		c.sinceSync = saRelax(c.tour, c.pos, temperature, c.len, rng, c.sinceSync);
+}
+
+/* bring c.tour up to date */
+void chainSync(SaChain &c) {
+	if (c.list != NULL)
+		c.list->toArray(c.tour);
+}
+
+void chainFree(SaChain &c) {
+	chainSync(c);
+	delete c.list;
+	if (c.arena == NULL)
+		free(c.pos);
+	c.list = NULL;
+	c.pos = NULL;
+}
+
+/*
+	One annealing run (saTSP) that can be stopped after any temperature
+	step and resumed, possibly on another thread: the pooled drivers run
+	it in phases of a few steps so idle workers can pick the run up.
+*/
+struct SaRun {
+	SaChain chain;
+	Rng rng;
+	float temperature;
+	int step;				// temperature steps done
+	double lastLen;
+	int contCnt;			// the continuous same length times
+	bool done;
+};
+
+void saRunInit(SaRun &r, int *tour, const Rng &rng, float t0 = INITEMP, Arena *arena = NULL) {
+	chainInit(r.chain, tour, arena);
+	r.rng = rng;
+	r.temperature = t0;
+	r.step = 0;
+	r.lastLen = r.chain.len;
+	r.contCnt = 0;
+	r.done = false;
+}
+
+/* start the next temperature step of r, false once the run has finished */
+bool saRunBegin(SaRun &r) {
+	if (r.temperature <= STOPTEMP) {
+		r.done = true;
+		return false;
+	}
+	r.temperature *= ALPHA;
+	r.step++;
+	return true;
+}
+
+/* after the step's proposals: stop once the length has settled */
+void saRunEnd(SaRun &r) {
+	if (fabs(r.chain.len - r.lastLen) < SAMELEN) {
+		r.contCnt += 1;
+		if (r.contCnt >= MAXLAST) {
+			//printf("unchanged for %d times1!\n", r.contCnt);
+			r.done = true;
+		}
+	}
+	else
+		r.contCnt = 0;
+	r.lastLen = r.chain.len;
+}
+
+/* at most steps temperature steps, returns true once the run is finished and the tour written back */
+bool saRunSteps(SaRun &r, int steps) {
+	for (int s = 0; s < steps && !r.done; ++s) {
+		if (!saRunBegin(r))
+			break;
+		chainRelax(r.chain, r.temperature, r.rng);
+		saRunEnd(r);
+	}
+	if (r.done)
+		chainFree(r.chain);
+	return r.done;
+}
+
+/* the proposals left[k] of the nlive chains live[], taking turns */
+template<class D>
+void saGroupRelax(const D &dist, SaRun **runs, SaRelaxer *st, int *live, int *left, int nlive) {
+	while (nlive > 0) {
+		for (int l = 0; l < nlive; ) {
+			int k = live[l];
+			SaChain &c = runs[k]->chain;
+			left[k] -= saPropose(dist, st[k], c.tour, c.pos, c.len, runs[k]->rng, c.sinceSync, left[k]);
+			if (left[k] == 0)
+				live[l] = live[--nlive];
+			else
+				++l;
+		}
+	}
+}
+
+/*
+	one temperature step of each of the cnt runs, interleaved: the array
+	chains take turns proposal by proposal, so while one waits for its
+	tour slots and distances the others keep the core busy. Each chain
+	stages its 2-opt proposals through its own SaPipe (--interleave
+	makes --prefetch at least 2), so the prefetches of a chain are a
+	whole turn of the others apart. A run therefore ends up with the
+	tour it would get alone with that --prefetch, whatever cnt is and
+	whichever runs share the thread. Two-level tours are relaxed one
+	after the other.
+*/
+void saRunGroupStep(SaRun **runs, int cnt) {
+	SaRelaxer st[INTERLEAVE_MAX];
+	int live[INTERLEAVE_MAX], left[INTERLEAVE_MAX], nlive = 0;
+	bool began[INTERLEAVE_MAX];
+	for (int k = 0; k < cnt; ++k) {
+		SaRun &r = *runs[k];
+		began[k] = !r.done && saRunBegin(r);
+		if (!began[k])
+			continue;
+		if (r.chain.list != NULL) {
+			chainRelax(r.chain, r.temperature, r.rng);
+			continue;
+		}
+		st[k].init(r.temperature, saPrefetch);
+		left[k] = RELAX;
+		live[nlive++] = k;
+	}
+	switch (distBackend()) {
+		case DB_DENSE_U16:
+			saGroupRelax(DistView<DB_DENSE_U16>(), runs, st, live, left, nlive);
+			break;
+		case DB_PACKED:
+			saGroupRelax(DistView<DB_PACKED>(), runs, st, live, left, nlive);
+			break;
+		case DB_PACKED_U16:
+			saGroupRelax(DistView<DB_PACKED_U16>(), runs, st, live, left, nlive);
+			break;
+		case DB_COORD:
+			saGroupRelax(DistView<DB_COORD>(), runs, st, live, left, nlive);
+			break;
+		default:
+			saGroupRelax(DistView<DB_DENSE>(), runs, st, live, left, nlive);
+	}
+	for (int k = 0; k < cnt; ++k) {
+		if (began[k])
+			saRunEnd(*runs[k]);
+		if (runs[k]->done)
+			chainFree(runs[k]->chain);
+	}
+}
+
+/* ns per getDist() over span x span cities, ways chains of reads that each depend on the one before */
+double saChaseNs(int span, int reads, int ways) {
+	int ci[INTERLEAVE_MAX], cj[INTERLEAVE_MAX];
+	for (int w = 0; w < ways; ++w) {
+		ci[w] = w * 7 % span;
+		cj[w] = (w * 13 + 5) % span;
+	}
+	struct timespec t0, t1;
+	float sum = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int k = 0; k < reads; k += ways) {
+		for (int w = 0; w < ways; ++w) {
+			float d = getDist(ci[w], cj[w]);
+			sum += d;
+			unsigned h = (unsigned)(ci[w] * 40503u + cj[w] * 2654435761u + (k + w) * 2246822519u) + (unsigned)d;	// k: no short cycles
+			ci[w] = (h >> 7) % span;
+			cj[w] = (h * 2246822519u >> 9) % span;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if (sum < 0)
+		printf("%f\n", sum);	// keep the loop
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / reads;
+}
+
+/*
+	chains per thread for --interleave=auto, from two measurements:
+	  - a proposal costs P ns of which about M (one miss, the extra
+	    latency of a random getDist() over one from L1) is waiting, and
+	    K - 1 other chains hide it when (K - 1) * (P - M) >= M
+	  - the core only keeps so many misses in flight (MLP, one chain of
+	    dependent reads against INTERLEAVE_MAX independent ones), and a
+	    2-opt proposal has its 4 distances in flight already, so K is at
+	    most MLP / 4
+	P is timed on 2-opt proposals that are evaluated but not applied, on
+	a random tour, so it does not depend on how many a random tour
+	accepts.
+*/
+int saCalibrateInterleave() {
+	int N = distN;
+	const int reads = 200000;
+	double lat = saChaseNs(N, reads, 1);
+	double miss = lat - saChaseNs(N < 16 ? N : 16, reads, 1);
+	double mlp = lat / saChaseNs(N, reads, INTERLEAVE_MAX);
+	Rng rng(0x5eed, 0);
+	int *tour = (int *)malloc(sizeof(int) * N);
+	int *pos = (candK > 0) ? (int *)malloc(sizeof(int) * N) : NULL;
+	for (int i = 0; i < N; ++i)
+		tour[i] = i;
+	for (int i = N - 1; i > 0; --i) {
+		int j = rng.bounded(i + 1);
+		int t = tour[i];
+		tour[i] = tour[j];
+		tour[j] = t;
+	}
+	for (int i = 0; pos != NULL && i < N; ++i)
+		pos[tour[i]] = i;
+	const int proposals = 200000;
+	Metropolis metro(STOPTEMP);
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < proposals; ++i) {
+		int p, q;
+		if (pos != NULL)
+			candidateBlock(tour, pos, N, rng, p, q);
+		else
+			randomBlock(N, rng, p, q);
+		saAccept(reverseDelta(tour, N, p, q), metro, rng);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	free(tour);
+	free(pos);
+	double prop = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / proposals;
+	int k = 1;
+	if (miss > 0.1 * prop)
+		k = 1 + (int)ceil(miss / (prop - miss > 1 ? prop - miss : 1));
+	int cap = (int)(mlp / 4);
+	if (k > cap)
+		k = (cap > 1) ? cap : 1;
+	if (k > INTERLEAVE_MAX)
+		k = INTERLEAVE_MAX;
+	printf("Interleave: %d chains per thread (miss %.0f ns, MLP %.1f, proposal %.0f ns)\n", k, miss, mlp, prop);
+	return k;
+}
+
+/* end the run early, the tour is written back */
+void saRunStop(SaRun &r) {
+	if (!r.done) {
+		r.done = true;
+		chainFree(r.chain);
+	}
+}
+
+/* the main simulated annealing function, t0 is the start temperature */
+void saTSP(int* tour, Rng &rng, float t0 = INITEMP) {
+	SaRun run;
+	saRunInit(run, tour, rng, t0);
+	while (!saRunSteps(run, 1 << 30))
+		;
+	rng = run.rng;
+	return;
+}
+
+#endif /* UTILS_ANNEAL_HPP_ */
@@ -0,0 +1,72 @@
+#ifndef UTILS_ARENA_HPP_
+#define UTILS_ARENA_HPP_
+
+/*
+	Bump allocator for one thread
+
+	Memory comes from ARENA_BLOCK sized blocks and is handed out in
+	cache-line aligned pieces, so the tours and scratch arrays a worker
+	allocates sit next to each other, are first touched by that worker
+	and never share a line with another thread's data. Nothing is freed
+	on its own: release() drops everything at once. Not thread-safe, give
+	every thread its own.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef ARENA_BLOCK
+	#define ARENA_BLOCK (1 << 20)	// Bytes per block
+#endif
+#define CACHE_LINE 64
+
+class Arena {
+	public:
+		Arena(): head(NULL) {
+		}
+
+		~Arena() {
+			release();
+		}
+
+		/* bytes of uninitialized memory, CACHE_LINE aligned */
+		void *alloc(size_t bytes) {
+			bytes = (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+			if (head == NULL || head->used + bytes > head->size) {
+				size_t size = (bytes > ARENA_BLOCK) ? bytes : ARENA_BLOCK;
+				void *p = NULL;
+				if (posix_memalign(&p, CACHE_LINE, sizeof(Block) + size)) {
+					fprintf(stderr, "Cannot allocate %zu bytes!\n", size);
+					exit(1);
+				}
+				Block *b = (Block *)p;
+				b->next = head;
+				b->size = size;
+				b->used = 0;
+				head = b;
+			}
+			void *p = (char *)head + sizeof(Block) + head->used;
+			head->used += bytes;
+			return p;
+		}
+
+		void release() {
+			while (head != NULL) {
+				Block *next = head->next;
+				free(head);
+				head = next;
+			}
+		}
+
+	private:
+		struct Block {
+			Block *next;
+			size_t size;
+			size_t used;
+			char pad[CACHE_LINE - 3 * sizeof(size_t)];	// the data starts on a line
+		};
+
+		Block *head;
+};
+
+#endif /* UTILS_ARENA_HPP_ */
@@ -0,0 +1,212 @@
+#ifndef UTILS_BATCH_HPP_
+#define UTILS_BATCH_HPP_
+
+/*
+	2-opt deltas and Metropolis tests for a batch of up to BATCH_MAX
+	proposals at once
+
+	batchReverseDelta() is reverseDelta() for cnt (p, q) pairs on the
+	same tour. Built with AVX-512 (-mavx512f) or AVX2 (-mavx2), e.g.
+	-march=native, it gathers the four endpoint cities and the four
+	distances of 16 / 8 proposals per instruction, for the dense float
+	matrix and for coordinates. Every other layout, ISA or matrix too big
+	for 32-bit gather offsets goes through the scalar loop. The float
+	operations are those of reverseDelta(), in the same order, with
+	dx*dx + dy*dy contracted to an FMA where GCC contracts it (the
+	default -ffp-contract=fast), so the deltas are bit-identical.
+
+	batchAccept() runs the Metropolis test of all lanes in the log form
+	of -DSA_ACCEPT_LOG, delta < -T*ln(u), with fastLog() in vector
+	registers: the exp() per uphill proposal was what one-at-a-time
+	evaluation spent most of its time on.
+*/
+
+#include <string.h>
+
+#include "distance.hpp"
+#include "moves.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+	#include <immintrin.h>
+#endif
+
+#define BATCH_MAX 16
+
+/*
+	ln(x) for normal x > 0, branch-free: offsetting the bits by those of
+	sqrt(1/2) splits x into 2^e * m with m in [0.71, 1.41), then an
+	atanh series on m, |error| < 3e-6
+*/
+inline float fastLog(float x) {
+	unsigned int i;
+	memcpy(&i, &x, sizeof(i));
+	i -= 0x3F3504F3;
+	int e = (int)i >> 23;
+	i = (i & 0x007FFFFF) + 0x3F3504F3;
+	float m;
+	memcpy(&m, &i, sizeof(m));
+	float t = (m - 1.0f) / (m + 1.0f), t2 = t * t;
+	return e * 0.69314718f + 2.0f * t * (1.0f + t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7))));
+}
+
+/* the vector kernels handle this layout */
+inline bool batchVector(int N) {
+#if defined(__AVX2__) || defined(__AVX512F__)
+	if (distMode == DIST_COORD)
+		return true;
+	return distMode == DIST_DENSE && distType == DTYPE_FLOAT && (long long)N * N < (1LL << 31);
+#else
+	(void)N;
+	return false;
+#endif
+}
+
+#ifdef __AVX512F__
+/*
+	full-mask gathers with a defined source: the plain ones (like
+	_mm512_sqrt_ps, _mm512_srai_epi32 and _mm512_cvtepi32_ps, hence their
+	maskz forms below) trip -Wmaybe-uninitialized in GCC 12
+*/
+inline __m512 gather16(__m512i k, const float *base) {
+	return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, k, base, 4);
+}
+
+inline __m512i gather16(__m512i k, const int *base) {
+	return _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xFFFF, k, base, 4);
+}
+
+/* 16 distances d(a[l], b[l]) */
+inline __m512 batchDist16(__m512i a, __m512i b, int N) {
+	const DistData *d = distLocal;
+	if (distMode == DIST_COORD) {
+		__m512 dx = _mm512_sub_ps(gather16(a, d->x), gather16(b, d->x));
+		__m512 dy = _mm512_sub_ps(gather16(a, d->y), gather16(b, d->y));
+		return _mm512_maskz_sqrt_ps(0xFFFF, _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy)));
+	}
+	__m512i k = _mm512_add_epi32(_mm512_mullo_epi32(a, _mm512_set1_epi32(N)), b);
+	return gather16(k, d->matrix);
+}
+#endif
+
+#ifdef __AVX2__
+/* 8 distances d(a[l], b[l]) */
+inline __m256 batchDist8(__m256i a, __m256i b, int N) {
+	const DistData *d = distLocal;
+	if (distMode == DIST_COORD) {
+		__m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(d->x, a, 4), _mm256_i32gather_ps(d->x, b, 4));
+		__m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(d->y, a, 4), _mm256_i32gather_ps(d->y, b, 4));
+  #ifdef __FMA__
+		return _mm256_sqrt_ps(_mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy)));
+  #else
+		return _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+  #endif
+	}
+	__m256i k = _mm256_add_epi32(_mm256_mullo_epi32(a, _mm256_set1_epi32(N)), b);
+	return _mm256_i32gather_ps(d->matrix, k, 4);
+}
+#endif
+
+/* delta[l] = reverseDelta(dist, tour, N, p[l], q[l]) for l < cnt <= BATCH_MAX */
+template<class D>
+inline void batchReverseDelta(const D &dist, const int *tour, int N, const int *p, const int *q, int cnt, float *delta) {
+	if (!batchVector(N)) {
+		for (int l = 0; l < cnt; ++l)
+			delta[l] = reverseDelta(dist, tour, N, p[l], q[l]);
+		return;
+	}
+#if defined(__AVX2__) || defined(__AVX512F__)
+	/* unused lanes evaluate the valid pair (0, 0) */
+	int bp[BATCH_MAX] = { 0 }, bq[BATCH_MAX] = { 0 };
+	for (int l = 0; l < cnt; ++l) {
+		bp[l] = p[l];
+		bq[l] = q[l];
+	}
+  #if defined(__AVX512F__)
+	__m512i n = _mm512_set1_epi32(N), one = _mm512_set1_epi32(1);
+	__m512i vp = _mm512_loadu_si512(bp), vq = _mm512_loadu_si512(bq);
+	__m512i p1 = _mm512_sub_epi32(vp, one);
+	p1 = _mm512_mask_add_epi32(p1, _mm512_cmplt_epi32_mask(p1, _mm512_setzero_si512()), p1, n);
+	__m512i q1 = _mm512_add_epi32(vq, one);
+	q1 = _mm512_mask_sub_epi32(q1, _mm512_cmpeq_epi32_mask(q1, n), q1, n);
+	__m512i tp = gather16(vp, tour), tq = gather16(vq, tour);
+	__m512i tp1 = gather16(p1, tour), tq1 = gather16(q1, tour);
+	__m512 d = _mm512_add_ps(batchDist16(tp, tq1, N), batchDist16(tp1, tq, N));
+	d = _mm512_sub_ps(d, batchDist16(tp, tp1, N));
+	d = _mm512_sub_ps(d, batchDist16(tq, tq1, N));
+	float out[BATCH_MAX];
+	_mm512_storeu_ps(out, d);
+	for (int l = 0; l < cnt; ++l)
+		delta[l] = out[l];
+  #elif defined(__AVX2__)
+	__m256i n = _mm256_set1_epi32(N), one = _mm256_set1_epi32(1);
+	for (int b = 0; b < cnt; b += 8) {
+		__m256i vp = _mm256_loadu_si256((const __m256i *)(bp + b));
+		__m256i vq = _mm256_loadu_si256((const __m256i *)(bq + b));
+		__m256i p1 = _mm256_sub_epi32(vp, one);
+		p1 = _mm256_add_epi32(p1, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), p1), n));
+		__m256i q1 = _mm256_add_epi32(vq, one);
+		q1 = _mm256_sub_epi32(q1, _mm256_and_si256(_mm256_cmpeq_epi32(q1, n), n));
+		__m256i tp = _mm256_i32gather_epi32(tour, vp, 4), tq = _mm256_i32gather_epi32(tour, vq, 4);
+		__m256i tp1 = _mm256_i32gather_epi32(tour, p1, 4), tq1 = _mm256_i32gather_epi32(tour, q1, 4);
+		__m256 d = _mm256_add_ps(batchDist8(tp, tq1, N), batchDist8(tp1, tq, N));
+		d = _mm256_sub_ps(d, batchDist8(tp, tp1, N));
+		d = _mm256_sub_ps(d, batchDist8(tq, tq1, N));
+		float out[8];
+		_mm256_storeu_ps(out, d);
+		for (int l = 0; l < 8 && b + l < cnt; ++l)
+			delta[b + l] = out[l];
+	}
+  #endif
+#endif
+}
+
+/* bit l set if lane l is accepted at temperature T, u[l] uniform in (0, 1] */
+inline unsigned batchAccept(const float *delta, const float *u, int cnt, float T) {
+	unsigned acc = 0;
+#if defined(__AVX2__) || defined(__AVX512F__)
+	/* unused lanes get delta 0, never accepted */
+	float bd[BATCH_MAX] = { 0 }, bu[BATCH_MAX];
+	for (int l = 0; l < BATCH_MAX; ++l)
+		bu[l] = 1;
+	memcpy(bd, delta, sizeof(float) * cnt);
+	memcpy(bu, u, sizeof(float) * cnt);
+  #if defined(__AVX512F__)
+	__m512 d = _mm512_loadu_ps(bd);
+	__m512i i = _mm512_sub_epi32(_mm512_castps_si512(_mm512_loadu_ps(bu)), _mm512_set1_epi32(0x3F3504F3));
+	__m512 e = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_srai_epi32(0xFFFF, i, 23));
+	__m512 m = _mm512_castsi512_ps(_mm512_add_epi32(_mm512_and_si512(i, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F3504F3)));
+	__m512 one = _mm512_set1_ps(1.0f);
+	__m512 t = _mm512_div_ps(_mm512_sub_ps(m, one), _mm512_add_ps(m, one)), t2 = _mm512_mul_ps(t, t);
+	__m512 s = _mm512_fmadd_ps(t2, _mm512_set1_ps(1.0f / 7), _mm512_set1_ps(1.0f / 5));
+	s = _mm512_fmadd_ps(t2, s, _mm512_set1_ps(1.0f / 3));
+	s = _mm512_fmadd_ps(t2, s, one);
+	__m512 lnU = _mm512_fmadd_ps(e, _mm512_set1_ps(0.69314718f), _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(2.0f), t), s));
+	__m512 thr = _mm512_mul_ps(_mm512_set1_ps(-T), lnU);
+	acc = _mm512_cmp_ps_mask(d, thr, _CMP_LT_OQ) & _mm512_cmp_ps_mask(d, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+  #else
+	for (int b = 0; b < cnt; b += 8) {
+		__m256 d = _mm256_loadu_ps(bd + b);
+		__m256i i = _mm256_sub_epi32(_mm256_castps_si256(_mm256_loadu_ps(bu + b)), _mm256_set1_epi32(0x3F3504F3));
+		__m256 e = _mm256_cvtepi32_ps(_mm256_srai_epi32(i, 23));
+		__m256 m = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_and_si256(i, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F3504F3)));
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one)), t2 = _mm256_mul_ps(t, t);
+		__m256 s = _mm256_add_ps(_mm256_mul_ps(t2, _mm256_set1_ps(1.0f / 7)), _mm256_set1_ps(1.0f / 5));
+		s = _mm256_add_ps(_mm256_mul_ps(t2, s), _mm256_set1_ps(1.0f / 3));
+		s = _mm256_add_ps(_mm256_mul_ps(t2, s), one);
+		__m256 lnU = _mm256_add_ps(_mm256_mul_ps(e, _mm256_set1_ps(0.69314718f)), _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), t), s));
+		__m256 thr = _mm256_mul_ps(_mm256_set1_ps(-T), lnU);
+		__m256 ok = _mm256_and_ps(_mm256_cmp_ps(d, thr, _CMP_LT_OQ), _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_NEQ_OQ));
+		acc |= (unsigned)_mm256_movemask_ps(ok) << b;
+	}
+  #endif
+#else
+	for (int l = 0; l < cnt; ++l) {
+		if (delta[l] != 0 && delta[l] < -T * fastLog(u[l]))
+			acc |= 1u << l;
+	}
+#endif
+	return acc & ((1u << cnt) - 1);
+}
+
+#endif /* UTILS_BATCH_HPP_ */
@@ -0,0 +1,234 @@
+#ifndef UTILS_CONSTRUCT_HPP_
+#define UTILS_CONSTRUCT_HPP_
+
+/*
+	Start tours
+
+	  --init=random|nn|greedy|hilbert
+	      random   a uniform permutation (the SA default)
+	      nn       nearest neighbor from a random city (the GA default):
+	               next city from the CONSTRUCT_K nearest-neighbor lists,
+	               a scan of the unvisited cities only when all of them
+	               are taken
+	      greedy   greedy edge matching over the same lists, the
+	               fragments joined nearest endpoint first
+	      hilbert  cities in Hilbert curve order (EUC_2D only, EXPLICIT
+	               instances get greedy)
+
+	greedy and hilbert are built once in initConstruct(), buildTour() is
+	then an O(n) copy and safe to call from any thread; so is nn, which
+	only reads the shared lists.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+
+#include "options.hpp"
+#include "distance.hpp"
+#include "neighbors.hpp"
+#include "rng.hpp"
+
+#ifndef CONSTRUCT_K
+	#define CONSTRUCT_K 10		// Neighbors per city for nn and greedy
+#endif
+
+enum InitMode { INIT_RANDOM = 0, INIT_NN, INIT_GREEDY, INIT_HILBERT };
+
+int initMode = INIT_RANDOM;		// --init
+int consK = 0;					// lists used by nn and greedy
+int *consList = NULL;
+int *consTour = NULL;			// the greedy / hilbert tour
+
+int parseInitMode(const char *name) {
+	if (strcmp(name, "random") == 0)
+		return INIT_RANDOM;
+	if (strcmp(name, "nn") == 0)
+		return INIT_NN;
+	if (strcmp(name, "greedy") == 0)
+		return INIT_GREEDY;
+	if (strcmp(name, "hilbert") == 0)
+		return INIT_HILBERT;
+	fprintf(stderr, "Unknown start tour: %s (random, nn, greedy or hilbert)\n", name);
+	exit(1);
+}
+
+const char *initModeName() {
+	static const char *names[] = { "random", "nn", "greedy", "hilbert" };
+	return names[initMode];
+}
+
+/* cities in Hilbert curve order */
+void hilbertTour(int *tour) {
+	hilbertOrder(distX, distY, distN, tour);
+}
+
+/* union-find root with path halving */
+static inline int consFind(int *parent, int a) {
+	while (parent[a] != a) {
+		parent[a] = parent[parent[a]];
+		a = parent[a];
+	}
+	return a;
+}
+
+/* walk the fragment that starts at endpoint e into tour[len..], returns the other end */
+static int consWalk(const int *adj, char *taken, int e, int *tour, int &len) {
+	int prev = -1, cur = e;
+	while (true) {
+		tour[len++] = cur;
+		taken[cur] = 1;
+		int nx = (adj[2 * cur] != prev) ? adj[2 * cur] : adj[2 * cur + 1];
+		if (nx < 0 || taken[nx])
+			return cur;
+		prev = cur;
+		cur = nx;
+	}
+}
+
+/* greedy edge over the consK lists */
+void greedyTour(int *tour) {
+	int n = distN;
+	std::pair<float, std::pair<int, int> > *edge = new std::pair<float, std::pair<int, int> >[(size_t)n * consK];
+	size_t m = 0;
+	for (int i = 0; i < n; ++i) {
+		for (int t = 0; t < consK; ++t) {
+			int j = consList[(size_t)i * consK + t];
+			edge[m++] = std::make_pair(getDist(i, j), std::make_pair(std::min(i, j), std::max(i, j)));
+		}
+	}
+	std::sort(edge, edge + m);
+	int *adj = (int *)malloc(sizeof(int) * 2 * n);
+	int *parent = (int *)malloc(sizeof(int) * n);
+	for (int i = 0; i < n; ++i) {
+		adj[2 * i] = adj[2 * i + 1] = -1;
+		parent[i] = i;
+	}
+	for (size_t e = 0; e < m; ++e) {
+		int a = edge[e].second.first, b = edge[e].second.second;
+		if (adj[2 * a + 1] >= 0 || adj[2 * b + 1] >= 0)
+			continue;		// degree 2 already
+		int ra = consFind(parent, a), rb = consFind(parent, b);
+		if (ra == rb)
+			continue;		// would close a cycle (or is the duplicate of an edge)
+		parent[ra] = rb;
+		adj[2 * a + (adj[2 * a] >= 0)] = b;
+		adj[2 * b + (adj[2 * b] >= 0)] = a;
+	}
+	delete[] edge;
+	free(parent);
+
+	/* join the fragments: from the end of one, go to the closest free endpoint */
+	char *taken = (char *)calloc(n, 1);
+	int *ends = (int *)malloc(sizeof(int) * n);
+	int nends = 0;
+	for (int i = 0; i < n; ++i) {
+		if (adj[2 * i + 1] < 0)
+			ends[nends++] = i;
+	}
+	int len = 0;
+	int tail = consWalk(adj, taken, ends[0], tour, len);
+	while (len < n) {
+		int next = -1;
+		for (int t = 0; t < consK && next < 0; ++t) {
+			int j = consList[(size_t)tail * consK + t];
+			if (!taken[j] && adj[2 * j + 1] < 0)
+				next = j;
+		}
+		if (next < 0) {
+			float best = 0;
+			int w = 0;
+			for (int e = 0; e < nends; ++e) {
+				int j = ends[e];
+				if (taken[j])
+					continue;
+				ends[w++] = j;		// drop taken endpoints as we go
+				if (next < 0 || getDist(tail, j) < best) {
+					best = getDist(tail, j);
+					next = j;
+				}
+			}
+			nends = w;
+		}
+		tail = consWalk(adj, taken, next, tour, len);
+	}
+	free(taken);
+	free(ends);
+	free(adj);
+}
+
+/* nearest neighbor from start, reentrant */
+void nnTour(int *tour, int start) {
+	int n = distN;
+	char *taken = (char *)calloc(n, 1);
+	int *left = (int *)malloc(sizeof(int) * n);	// unvisited cities, swap-removed
+	int *where = (int *)malloc(sizeof(int) * n);
+	for (int i = 0; i < n; ++i)
+		left[i] = where[i] = i;
+	int nleft = n;
+	int cur = start;
+	for (int k = 0; k < n; ++k) {
+		tour[k] = cur;
+		taken[cur] = 1;
+		int w = where[cur];
+		left[w] = left[--nleft];
+		where[left[w]] = w;
+		int next = -1;
+		for (int t = 0; t < consK && next < 0; ++t) {
+			int j = consList[(size_t)cur * consK + t];
+			if (!taken[j])
+				next = j;
+		}
+		if (next < 0 && nleft > 0) {
+			next = left[0];
+			for (int i = 1; i < nleft; ++i) {
+				if (getDist(cur, left[i]) < getDist(cur, next))
+					next = left[i];
+			}
+		}
+		cur = next;
+	}
+	free(taken);
+	free(left);
+	free(where);
+}
+
+/* read --init (default def) and prepare the builder, call after the instance is loaded */
+void initConstruct(const char *def) {
+	initMode = parseInitMode(optionValue("init", def));
+	if (initMode == INIT_HILBERT && distX == NULL)
+		initMode = INIT_GREEDY;
+	if (initMode == INIT_RANDOM || distN < 8)
+		return;
+	if (initMode != INIT_HILBERT) {
+		consK = std::min(CONSTRUCT_K, distN - 1);
+		consList = newNeighbors(consK);
+	}
+	if (initMode == INIT_NN)
+		return;
+	consTour = (int *)malloc(sizeof(int) * distN);
+	if (initMode == INIT_GREEDY)
+		greedyTour(consTour);
+	else
+		hilbertTour(consTour);
+}
+
+/* a start tour as picked by --init, true unless it is random */
+bool buildTour(int *tour, Rng &rng) {
+	int n = distN;
+	if (initMode == INIT_RANDOM || n < 8) {
+		for (int j = 0; j < n; ++j)
+			tour[j] = j;
+		rng.shuffle(tour, n);
+		return false;
+	}
+	if (initMode == INIT_NN)
+		nnTour(tour, rng.bounded(n));
+	else
+		memcpy(tour, consTour, sizeof(int) * n);
+	return true;
+}
+
+#endif /* UTILS_CONSTRUCT_HPP_ */
@@ -0,0 +1,309 @@
+#ifndef UTILS_DISTANCE_HPP_
+#define UTILS_DISTANCE_HPP_
+
+/*
+	Distance backends behind getDist(i, j)
+
+	DIST_DENSE: the n*n matrix, O(n^2) memory. Used for EXPLICIT
+	            instances and for small EUC_2D ones.
+	DIST_PACKED: only the lower triangle of the (symmetric) matrix,
+	            n*(n+1)/2 entries at triIndex(i, j): half the memory of
+	            dense for one max/min more per lookup, so about 1.4x the
+	            cities fit in the same RAM / cache.
+	DIST_COORD: EUC_2D only, distances are computed on the fly from the
+	            x[] / y[] coordinate arrays, O(n) memory. This is what
+	            makes ch71009 (a ~20 GB matrix) fit.
+
+	Selected with --dist=auto|dense|packed|coord, auto keeps the dense
+	matrix up to DENSE_MAXN cities.
+
+	The dense or packed matrix is stored as --dtype=auto|float|u16:
+	  float  4 bytes per entry
+	  u16    uint16_t, half the footprint (a 1000-city matrix is 2 MB)
+	auto picks u16 when every weight is a whole number up to 65535 (the
+	EXPLICIT instances, gr17, fri26, dantzig42, ...), float otherwise.
+	u16 weights are stored as they are; a move delta adds up at most
+	eight of them, far below float's 2^24, so those deltas are exact.
+	Whole weights beyond 2^24 are already rounded by the float loader.
+	Forcing u16 on real-valued weights (EUC_2D) stores them in fixed
+	point, rounded to 1/distScale, distScale = 65535 / max weight.
+
+	--renumber permutes the cities before any of this (utils/renumber.hpp),
+	cities are then numbered 0..n-1 in the new order and cityId() gives
+	back the index in the file.
+
+	getDist() reads through the calling thread's distLocal, which points
+	at distHome (the arrays above) unless utils/numa.hpp bound the thread
+	to a replica on its own NUMA node. That is a thread-local load and a
+	branch on the mode and type per lookup; the SA kernels instead take
+	a DistView<B>, which resolves both once per call (distBackend()).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "tsplib.hpp"
+#include "renumber.hpp"
+#include "options.hpp"
+
+#define DENSE_MAXN 4096		// auto mode: largest EUC_2D instance that gets a dense matrix
+
+enum DistMode { DIST_AUTO = 0, DIST_DENSE, DIST_PACKED, DIST_COORD };
+enum DistType { DTYPE_AUTO = 0, DTYPE_FLOAT, DTYPE_U16 };
+
+int distMode = DIST_DENSE;
+int distType = DTYPE_FLOAT;
+int distN = 0;					// Number of cities
+size_t distCount = 0;			// entries in the matrix
+float *distMatrix = NULL;		// DTYPE_FLOAT: n*n row-major, or packed
+uint16_t *distU16 = NULL;		// DTYPE_U16
+float distScale = 1;			// stored value = weight * distScale
+float distInvScale = 1;
+float *distX = NULL;			// EUC_2D coordinates, struct of arrays (NULL for EXPLICIT)
+float *distY = NULL;
+int *distOrig = NULL;			// --renumber: file index of each city (NULL: identity)
+
+/* the arrays getDist() reads, one set per copy of the data */
+struct DistData {
+	float *matrix;
+	uint16_t *u16;
+	float *x;
+	float *y;
+};
+
+DistData distHome = { NULL, NULL, NULL, NULL };
+static __thread const DistData *distLocal = &distHome;
+
+/* index of city c in the file, for output */
+inline int cityId(int c) {
+	return (distOrig != NULL) ? distOrig[c] : c;
+}
+
+inline float getDist(int i, int j) {
+	const DistData *d = distLocal;
+	if (distMode == DIST_COORD)
+		return eucDist(d->x, d->y, i, j);
+	size_t k = (distMode == DIST_PACKED) ? triIndex(i, j) : (size_t)i * distN + j;
+	if (distType == DTYPE_U16)
+		return d->u16[k] * distInvScale;
+	return d->matrix[k];
+}
+
+/* start loading what getDist(i, j) will read */
+inline void prefetchDist(int i, int j) {
+	const DistData *d = distLocal;
+	if (distMode == DIST_COORD) {
+		__builtin_prefetch(&d->x[i]);
+		__builtin_prefetch(&d->y[i]);
+		__builtin_prefetch(&d->x[j]);
+		__builtin_prefetch(&d->y[j]);
+		return;
+	}
+	size_t k = (distMode == DIST_PACKED) ? triIndex(i, j) : (size_t)i * distN + j;
+	if (distType == DTYPE_U16)
+		__builtin_prefetch(&d->u16[k]);
+	else
+		__builtin_prefetch(&d->matrix[k]);
+}
+
+/* the layouts DistView is compiled for */
+enum DistBackend { DB_DENSE = 0, DB_DENSE_U16, DB_PACKED, DB_PACKED_U16, DB_COORD };
+
+inline int distBackend() {
+	if (distMode == DIST_COORD)
+		return DB_COORD;
+	bool u16 = (distType == DTYPE_U16);
+	if (distMode == DIST_PACKED)
+		return u16 ? DB_PACKED_U16 : DB_PACKED;
+	return u16 ? DB_DENSE_U16 : DB_DENSE;
+}
+
+/*
+	getDist() / prefetchDist() for backend B, with the calling thread's
+	arrays read once at construction: a lookup is the index math of B
+	and one load. Kernels take the view as a template argument and
+	distBackend() picks the instance per call.
+*/
+template<int B>
+struct DistView {
+	const float *matrix;
+	const uint16_t *u16;
+	const float *x, *y;
+	size_t n;
+	float inv;
+
+	DistView(): matrix(distLocal->matrix), u16(distLocal->u16), x(distLocal->x), y(distLocal->y), n(distN), inv(distInvScale) {
+	}
+
+	inline size_t index(int i, int j) const {
+		return (B == DB_PACKED || B == DB_PACKED_U16) ? triIndex(i, j) : (size_t)i * n + j;
+	}
+
+	inline float operator()(int i, int j) const {
+		if (B == DB_COORD)
+			return eucDist(x, y, i, j);
+		if (B == DB_DENSE_U16 || B == DB_PACKED_U16)
+			return u16[index(i, j)] * inv;
+		return matrix[index(i, j)];
+	}
+
+	inline void prefetch(int i, int j) const {
+		if (B == DB_COORD) {
+			__builtin_prefetch(&x[i]);
+			__builtin_prefetch(&y[i]);
+			__builtin_prefetch(&x[j]);
+			__builtin_prefetch(&y[j]);
+		}
+		else if (B == DB_DENSE_U16 || B == DB_PACKED_U16)
+			__builtin_prefetch(&u16[index(i, j)]);
+		else
+			__builtin_prefetch(&matrix[index(i, j)]);
+	}
+};
+
+/* plain getDist() behind the DistView interface, for code that is not hot */
+struct DistAny {
+	inline float operator()(int i, int j) const {
+		return getDist(i, j);
+	}
+
+	inline void prefetch(int i, int j) const {
+		prefetchDist(i, j);
+	}
+};
+
+/* bytes per matrix entry */
+inline size_t distEntrySize() {
+	return (distType == DTYPE_U16) ? sizeof(uint16_t) : sizeof(float);
+}
+
+/* parse the --dist option value */
+int parseDistMode(const char *name) {
+	if (name == NULL || strcmp(name, "auto") == 0)
+		return DIST_AUTO;
+	if (strcmp(name, "dense") == 0)
+		return DIST_DENSE;
+	if (strcmp(name, "packed") == 0)
+		return DIST_PACKED;
+	if (strcmp(name, "coord") == 0)
+		return DIST_COORD;
+	fprintf(stderr, "Unknown distance mode: %s (auto|dense|packed|coord)\n", name);
+	exit(1);
+}
+
+int parseDistType(const char *name) {
+	if (name == NULL || strcmp(name, "auto") == 0)
+		return DTYPE_AUTO;
+	if (strcmp(name, "float") == 0)
+		return DTYPE_FLOAT;
+	if (strcmp(name, "u16") == 0)
+		return DTYPE_U16;
+	fprintf(stderr, "Unknown distance type: %s (auto|float|u16)\n", name);
+	exit(1);
+}
+
+/* re-store the float matrix d (cnt entries) as type, d is freed unless type is float */
+void packDistMatrix(float *d, size_t cnt, int type) {
+	distCount = cnt;
+	float maxD = 0;
+	bool whole = true;
+	for (size_t k = 0; k < cnt; ++k) {
+		if (d[k] > maxD)
+			maxD = d[k];
+		if (d[k] != floorf(d[k]) || d[k] < 0)
+			whole = false;
+	}
+	if (type == DTYPE_AUTO)
+		type = (whole && maxD <= 65535) ? DTYPE_U16 : DTYPE_FLOAT;
+	distType = type;
+	distScale = distInvScale = 1;
+	if (type == DTYPE_FLOAT) {
+		distMatrix = d;
+		return;
+	}
+	if (!(whole && maxD <= 65535) && maxD > 0) {
+		distScale = 65535.0f / maxD;
+		distInvScale = 1.0f / distScale;
+	}
+	distU16 = (uint16_t *)malloc(sizeof(uint16_t) * cnt);
+	for (size_t k = 0; k < cnt; ++k)
+		distU16[k] = (uint16_t)lrintf(d[k] * distScale);
+	free(d);
+}
+
+/* every getDist() is a whole number */
+bool distWholeNumbers() {
+	if (distMode == DIST_COORD)
+		return false;
+	if (distType != DTYPE_FLOAT)
+		return distScale == 1;
+	for (size_t k = 0; k < distCount; ++k) {
+		if (distMatrix[k] != (int)distMatrix[k])
+			return false;
+	}
+	return true;
+}
+
+/* set up the distance backend for inst, renumbers inst if asked to, inst may be freed afterwards */
+void initDistance(TSPInstance &inst, const char *modeName) {
+	int mode = parseDistMode(modeName);
+	distN = inst.n;
+	if (optionValue("renumber", NULL) != NULL && inst.n > 2) {
+		distOrig = (int *)malloc(sizeof(int) * inst.n);
+		renumberOrder(inst, distOrig);
+		permuteInstance(inst, distOrig);
+	}
+	if (inst.weightType != WEIGHT_EUC_2D) {
+		if (mode == DIST_COORD) {
+			fprintf(stderr, "--dist=coord needs an EUC_2D instance!\n");
+			exit(1);
+		}
+		if (mode != DIST_PACKED)
+			mode = DIST_DENSE;
+	}
+	if (mode == DIST_AUTO)
+		mode = (inst.n <= DENSE_MAXN) ? DIST_DENSE : DIST_COORD;
+	distMode = mode;
+	if (mode != DIST_COORD) {
+		size_t cnt = (mode == DIST_PACKED) ? (size_t)inst.n * (inst.n + 1) / 2 : (size_t)inst.n * inst.n;
+		packDistMatrix(buildDistMatrix(inst, mode == DIST_PACKED), cnt, parseDistType(optionValue("dtype", "auto")));
+	}
+	/* the coordinates are kept in both modes, they are O(n) */
+	if (inst.weightType == WEIGHT_EUC_2D) {
+		distX = (float *)malloc(sizeof(float) * inst.n);
+		distY = (float *)malloc(sizeof(float) * inst.n);
+		memcpy(distX, inst.coordX, sizeof(float) * inst.n);
+		memcpy(distY, inst.coordY, sizeof(float) * inst.n);
+	}
+	DistData home = { distMatrix, distU16, distX, distY };
+	distHome = home;
+}
+
+const char *distModeName() {
+	static const char *names[] = { "auto", "dense", "packed", "coord" };
+	return names[distMode];
+}
+
+const char *distTypeName() {
+	static const char *names[] = { "auto", "float", "u16" };
+	return names[distType];
+}
+
+void freeDistance() {
+	free(distMatrix);
+	free(distU16);
+	free(distX);
+	free(distY);
+	free(distOrig);
+	distMatrix = distX = distY = NULL;
+	distOrig = NULL;
+	DistData none = { NULL, NULL, NULL, NULL };
+	distHome = none;
+	distU16 = NULL;
+	distCount = 0;
+}
+
+#endif /* UTILS_DISTANCE_HPP_ */
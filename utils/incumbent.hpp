@@ -0,0 +1,133 @@
+#ifndef UTILS_INCUMBENT_HPP_
+#define UTILS_INCUMBENT_HPP_
+
+/*
+	Best-so-far tour shared by concurrent SA restarts, without locks
+
+	The length is an atomic float every run can poll for free; the tour
+	sits behind a seqlock: a writer makes the sequence odd, copies, and
+	makes it even again, a reader retries until it saw the same even
+	sequence before and after its copy.
+
+	All restarts walk the same temperature schedule, so next to the
+	incumbent we keep the shortest length any run had after each
+	temperature step. With --abandon=M (fraction, e.g. 0.02; default 0,
+	off) a run that is more than M above that record at a step below
+	--abandontemp=T (default 5) is hopeless: it stops there, or with
+	--reseed continues from a copy of the incumbent tour. Which runs get
+	cut depends on thread timing and can change the best answer, so it
+	is opt-in. Lengths at high temperatures say little about the final
+	one, so the temperature default is cautious.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <atomic>
+
+#include "options.hpp"
+#include "anneal.hpp"
+
+class Incumbent {
+	public:
+		Incumbent(): n(0), tour(NULL), steps(0), stepBest(NULL), len(FLT_MAX), seq(0) {
+		}
+
+		~Incumbent() {
+			free(tour);
+			delete[] stepBest;
+		}
+
+		/* tours of n cities, records for temperature steps [0, _steps) */
+		void init(int _n, int _steps) {
+			n = _n;
+			steps = _steps;
+			tour = (int *)realloc(tour, sizeof(int) * n);
+			delete[] stepBest;
+			stepBest = new std::atomic<float>[steps];
+			for (int i = 0; i < steps; ++i)
+				stepBest[i].store(FLT_MAX);
+			len.store(FLT_MAX);
+			seq.store(0);
+		}
+
+		inline float length() const {
+			return len.load(std::memory_order_relaxed);
+		}
+
+		/* offer tour t of length l, true if it became the incumbent */
+		bool publish(const int *t, float l) {
+			if (l >= length())
+				return false;
+			unsigned s = seq.load(std::memory_order_relaxed);
+			while (true) {
+				if ((s & 1) == 0 && seq.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+					break;
+				s = seq.load(std::memory_order_relaxed);
+			}
+			bool better = (l < len.load(std::memory_order_relaxed));
+			if (better) {
+				memcpy(tour, t, sizeof(int) * n);
+				len.store(l, std::memory_order_relaxed);
+			}
+			seq.store(s + 2, std::memory_order_release);
+			return better;
+		}
+
+		/* copy the incumbent to t, returns its length (FLT_MAX: none yet) */
+		float read(int *t) {
+			while (true) {
+				unsigned s = seq.load(std::memory_order_acquire);
+				if (s & 1)
+					continue;
+				float l = len.load(std::memory_order_relaxed);
+				memcpy(t, tour, sizeof(int) * n);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (seq.load(std::memory_order_relaxed) == s)
+					return l;
+			}
+		}
+
+		/* length l after temperature step s: lower the record, return the record before */
+		float record(int s, float l) {
+			if (s >= steps)
+				return FLT_MAX;
+			float old = stepBest[s].load(std::memory_order_relaxed);
+			while (l < old && !stepBest[s].compare_exchange_weak(old, l, std::memory_order_relaxed))
+				;
+			return old;
+		}
+
+	private:
+		int n;
+		int *tour;
+		int steps;
+		std::atomic<float> *stepBest;
+		std::atomic<float> len;
+		std::atomic<unsigned> seq;		// odd while a writer copies
+};
+
+Incumbent incumbent;
+float abandonMargin = 0;			// --abandon, 0: off
+float abandonTemp = 5;				// --abandontemp
+bool abandonReseed = false;		// --reseed
+std::atomic<int> abandoned(0);	// hopeless restarts seen
+
+/* read the options and clear the incumbent for tours of n cities */
+void initIncumbent(int n) {
+	abandonMargin = optionDouble("abandon", 0);
+	abandonTemp = optionDouble("abandontemp", 5);
+	abandonReseed = (optionValue("reseed", NULL) != NULL);
+	if (abandonMargin < 0) {
+		fprintf(stderr, "Bad abandon margin: %g\n", abandonMargin);
+		exit(1);
+	}
+	/* steps from INITEMP down to STOPTEMP, plus slack for rounding */
+	int steps = (int)(log(STOPTEMP / INITEMP) / log(ALPHA)) + 16;
+	incumbent.init(n, steps);
+	abandoned = 0;
+}
+
+#endif /* UTILS_INCUMBENT_HPP_ */
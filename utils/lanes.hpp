@@ -0,0 +1,319 @@
+#ifndef UTILS_LANES_HPP_
+#define UTILS_LANES_HPP_
+
+/*
+	SA chains in SIMD lanes, the CPU port of parallel/cuda/cuda_SA_TSP.cu
+
+	The CUDA kernel runs one lightweight chain per GPU thread: a random
+	start tour, 2-opt block reverses only, RELAX proposals per
+	temperature from INITEMP down to STOPTEMP, every thread at the same
+	temperature. A LaneBlock runs LANES such chains (16 with AVX-512, 8
+	with AVX2, 4 with SSE2) in lockstep, one chain per lane, as a warp
+	would:
+	  - the tours are struct-of-arrays, the city at position i of lane l
+	    is tour[i * LANES + l], so one gather fetches a position of every
+	    lane
+	  - LaneRng is xoshiro128** with one 32-bit state per lane, every
+	    lane draws its p, q and u at once
+	  - the endpoint cities and the four distances of all lanes are
+	    gathered (dense float matrix or coordinates, any other layout
+	    goes through getDist() lane by lane)
+	  - the Metropolis test runs on all lanes in the log form of
+	    -DSA_ACCEPT_LOG, delta < -T*ln(u), and yields a lane mask
+	  - the accepted lanes reverse their shorter side together, masked
+	    gathers and scatters of one swap per lane and iteration; with
+	    fewer than LANE_SPLIT lanes accepted (or without AVX-512
+	    scatters) each lane reverses on its own, since the masked loop
+	    runs as long as the longest reversal, like a divergent warp
+	The lane types are GCC vector extensions, so the arithmetic is SIMD
+	on whatever x86 ISA the build enables (build with -march=native);
+	the gathers and scatters use AVX-512 or AVX2 when they are there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "distance.hpp"
+#include "anneal.hpp"
+#include "rng.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+	#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+	#define LANES 16
+#elif defined(__AVX2__)
+	#define LANES 8
+#else
+	#define LANES 4		// SSE2
+#endif
+#ifndef LANE_SPLIT
+	#define LANE_SPLIT (LANES / 2)	// Fewest accepted lanes that reverse together
+#endif
+
+typedef int32_t LaneInt __attribute__((vector_size(4 * LANES)));
+typedef uint32_t LaneUint __attribute__((vector_size(4 * LANES)));
+typedef float LaneFloat __attribute__((vector_size(4 * LANES)));
+
+/* l in lane l */
+inline LaneInt laneIndex() {
+	LaneInt r;
+	for (int l = 0; l < LANES; ++l)
+		r[l] = l;
+	return r;
+}
+
+/* x in every lane */
+inline LaneInt laneSplat(int x) {
+	LaneInt r = {};
+	return r + x;
+}
+
+/* some lane of the mask m is set */
+inline bool laneAny(LaneInt m) {
+#if defined(__AVX512F__)
+	return _mm512_test_epi32_mask((__m512i)m, (__m512i)m) != 0;
+#elif defined(__AVX2__)
+	return !_mm256_testz_si256((__m256i)m, (__m256i)m);
+#else
+	for (int l = 0; l < LANES; ++l) {
+		if (m[l] != 0)
+			return true;
+	}
+	return false;
+#endif
+}
+
+/* xoshiro128** (Blackman & Vigna) in every lane */
+struct LaneRng {
+	LaneUint s0, s1, s2, s3;
+
+	/* lane l continues from rng[l], which stays untouched */
+	void seed(Rng *rng) {
+		for (int l = 0; l < LANES; ++l) {
+			Rng r = rng[l];
+			uint64_t a = r.next(), b = r.next();
+			s0[l] = (uint32_t)a;
+			s1[l] = (uint32_t)(a >> 32);
+			s2[l] = (uint32_t)b;
+			s3[l] = (uint32_t)(b >> 32) | 1;	// never the all-zero state
+		}
+	}
+
+	static inline LaneUint rotl(LaneUint x, int k) {
+		return (x << k) | (x >> (32 - k));
+	}
+
+	inline LaneUint next() {
+		LaneUint ret = rotl(s1 * 5, 7) * 9;
+		LaneUint t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = rotl(s3, 11);
+		return ret;
+	}
+
+	/* uniform in [0, n) with 24 bits, n <= 2^24 */
+	inline LaneInt bounded(int n) {
+		LaneFloat u = __builtin_convertvector((LaneInt)(next() >> 8), LaneFloat) * (1.0f / 16777216.0f);
+		LaneInt r = __builtin_convertvector(u * (float)n, LaneInt);
+		return (r < n) ? r : laneSplat(n - 1);		// u * n may round up to n
+	}
+
+	/* uniform in (0, 1], safe for the log */
+	inline LaneFloat uniformOpen() {
+		return __builtin_convertvector((LaneInt)(next() >> 8) + 1, LaneFloat) * (1.0f / 16777216.0f);
+	}
+};
+
+/* fastLog() (utils/batch.hpp) in every lane */
+inline LaneFloat laneLog(LaneFloat x) {
+	LaneInt i = (LaneInt)x - 0x3F3504F3;
+	LaneFloat e = __builtin_convertvector(i >> 23, LaneFloat);
+	LaneFloat m = (LaneFloat)((i & 0x007FFFFF) + 0x3F3504F3);
+	LaneFloat t = (m - 1.0f) / (m + 1.0f), t2 = t * t;
+	return e * 0.69314718f + 2.0f * t * (1.0f + t2 * (1.0f / 3 + t2 * (1.0f / 5 + t2 * (1.0f / 7))));
+}
+
+inline LaneInt laneGather(const int *base, LaneInt k) {
+#if defined(__AVX512F__)
+	return (LaneInt)_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), 0xFFFF, (__m512i)k, base, 4);
+#elif defined(__AVX2__)
+	return (LaneInt)_mm256_i32gather_epi32(base, (__m256i)k, 4);
+#else
+	LaneInt r;
+	for (int l = 0; l < LANES; ++l)
+		r[l] = base[k[l]];
+	return r;
+#endif
+}
+
+inline LaneFloat laneGather(const float *base, LaneInt k) {
+#if defined(__AVX512F__)
+	return (LaneFloat)_mm512_mask_i32gather_ps(_mm512_setzero_ps(), 0xFFFF, (__m512i)k, base, 4);
+#elif defined(__AVX2__)
+	return (LaneFloat)_mm256_i32gather_ps(base, (__m256i)k, 4);
+#else
+	LaneFloat r;
+	for (int l = 0; l < LANES; ++l)
+		r[l] = base[k[l]];
+	return r;
+#endif
+}
+
+/* d(a[l], b[l]) in every lane */
+inline LaneFloat laneDist(LaneInt a, LaneInt b, int N) {
+	const DistData *d = distLocal;
+	LaneFloat r;
+	if (distMode == DIST_COORD) {
+		LaneFloat dx = laneGather(d->x, a) - laneGather(d->x, b);
+		LaneFloat dy = laneGather(d->y, a) - laneGather(d->y, b);
+		LaneFloat s = dx * dx + dy * dy;
+#if defined(__AVX512F__)
+		return (LaneFloat)_mm512_maskz_sqrt_ps(0xFFFF, (__m512)s);
+#elif defined(__AVX2__)
+		return (LaneFloat)_mm256_sqrt_ps((__m256)s);
+#else
+		for (int l = 0; l < LANES; ++l)
+			r[l] = sqrtf(s[l]);
+		return r;
+#endif
+	}
+	if (distMode == DIST_DENSE && distType == DTYPE_FLOAT)
+		return laneGather(d->matrix, a * N + b);
+	for (int l = 0; l < LANES; ++l)
+		r[l] = getDist(a[l], b[l]);
+	return r;
+}
+
+/* LANES chains, lane l anneals the tour at tour[i * LANES + l] */
+struct LaneBlock {
+	int *tour;
+	LaneRng rng;
+};
+
+/* random start tours for chains first..first + LANES - 1, chain c shuffles with Rng stream c */
+void laneInit(LaneBlock &b, int N, int first) {
+	if (posix_memalign((void **)&b.tour, CACHE_LINE, sizeof(int) * N * LANES)) {
+		fprintf(stderr, "Cannot allocate the lane tours!\n");
+		exit(1);
+	}
+	Rng rng[LANES];
+	int *t = (int *)malloc(sizeof(int) * N);
+	for (int l = 0; l < LANES; ++l) {
+		rng[l] = Rng(rngSeed, first + l);
+		for (int i = 0; i < N; ++i)
+			t[i] = i;
+		rng[l].shuffle(t, N);
+		for (int i = 0; i < N; ++i)
+			b.tour[i * LANES + l] = t[i];
+	}
+	free(t);
+	b.rng.seed(rng);
+}
+
+/* lane l's tour */
+void laneTour(const LaneBlock &b, int N, int l, int *out) {
+	for (int i = 0; i < N; ++i)
+		out[i] = b.tour[i * LANES + l];
+}
+
+void laneFree(LaneBlock &b) {
+	free(b.tour);
+	b.tour = NULL;
+}
+
+/* applyReverse() of [p[l], q[l]] in the lanes of acc, all at once */
+inline void laneReverse(int *tour, int N, LaneInt p, LaneInt q, LaneInt acc) {
+	/* the shorter side, wrapping */
+	LaneInt len = q - p + 1;
+	LaneInt flip = (2 * len > N);
+	LaneInt np = flip ? q + 1 : p;
+	q = flip ? p - 1 + N : q;
+	p = np;
+	len = flip ? N - len : len;
+	LaneInt half = acc ? len >> 1 : laneSplat(0);
+	int kmax = 0, cnt = 0;
+	for (int l = 0; l < LANES; ++l) {
+		kmax = (half[l] > kmax) ? half[l] : kmax;
+		cnt += (acc[l] != 0);
+	}
+#ifdef __AVX512F__
+	if (cnt >= LANE_SPLIT) {
+		const LaneInt lane = laneIndex();
+		for (int k = 0; k < kmax; ++k) {
+			__mmask16 on = _mm512_cmpgt_epi32_mask((__m512i)half, _mm512_set1_epi32(k));
+			LaneInt i = p + k, j = q - k;
+			i = (i >= N) ? i - N : i;
+			j = (j >= N) ? j - N : j;
+			__m512i ki = (__m512i)(i * LANES + lane), kj = (__m512i)(j * LANES + lane);
+			__m512i a = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), on, ki, tour, 4);
+			__m512i c = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), on, kj, tour, 4);
+			_mm512_mask_i32scatter_epi32(tour, on, ki, c, 4);
+			_mm512_mask_i32scatter_epi32(tour, on, kj, a, 4);
+		}
+		return;
+	}
+#endif
+	(void)cnt;
+	for (int l = 0; l < LANES; ++l) {
+		for (int k = 0; k < half[l]; ++k) {
+			int i = p[l] + k, j = q[l] - k;
+			if (i >= N)
+				i -= N;
+			if (j >= N)
+				j -= N;
+			int tmp = tour[i * LANES + l];
+			tour[i * LANES + l] = tour[j * LANES + l];
+			tour[j * LANES + l] = tmp;
+		}
+	}
+}
+
+/*
+	the kernel: RELAX proposals per temperature step from t0 down to
+	STOPTEMP, every lane at the same temperature and, as in the CUDA
+	version, no early stop
+*/
+void laneAnneal(LaneBlock &b, int N, float t0) {
+	const LaneInt lane = laneIndex();
+	const LaneInt n = laneSplat(N), zero = laneSplat(0);
+	float temperature = t0;
+	while (temperature > STOPTEMP) {
+		temperature *= ALPHA;
+		for (int i = 0; i < RELAX; ++i) {
+			/* Proposal: Block Reverse between p and q, randomBlock() in every lane */
+			LaneInt p = b.rng.bounded(N), q = b.rng.bounded(N);
+			LaneInt ends = (p - q == N - 1) | (q - p == N - 1);
+			if (laneAny(ends)) {
+				LaneInt q2 = b.rng.bounded(N - 1), p2 = b.rng.bounded(N - 2);
+				q = ends ? q2 : q;
+				p = ends ? p2 : p;
+			}
+			LaneInt q2 = q + 2;
+			q = (p == q) ? ((q2 >= N) ? q2 - n : q2) : q;
+			LaneInt lo = (p < q) ? p : q;
+			q = (p < q) ? q : p;
+			p = lo;
+			LaneInt p1 = (p == 0) ? n - 1 : p - 1;
+			LaneInt q1 = (q == N - 1) ? zero : q + 1;
+			LaneInt tp = laneGather(b.tour, p * LANES + lane), tq = laneGather(b.tour, q * LANES + lane);
+			LaneInt tp1 = laneGather(b.tour, p1 * LANES + lane), tq1 = laneGather(b.tour, q1 * LANES + lane);
+			LaneFloat delta = laneDist(tp, tq1, N) + laneDist(tp1, tq, N) - laneDist(tp, tp1, N) - laneDist(tq, tq1, N);
+
+			/* whether to accept the change, in every lane */
+			LaneFloat u = b.rng.uniformOpen();
+			LaneInt acc = (delta < 0) | ((delta > 0) & (delta < -temperature * laneLog(u)));
+			if (laneAny(acc))
+				laneReverse(b.tour, N, p, q, acc);
+		}
+	}
+}
+
+#endif /* UTILS_LANES_HPP_ */
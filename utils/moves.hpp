@@ -0,0 +1,164 @@
+#ifndef UTILS_MOVES_HPP_
+#define UTILS_MOVES_HPP_
+
+/*
+	SA moves on an array tour: O(1) delta evaluation + apply
+
+	Positions are cyclic, pos[] (city -> position) may be NULL; when it
+	is given every apply keeps it up to date. The deltas read distances
+	through dist, a DistView (or DistAny, which the overloads without
+	it use).
+
+	- block reverse (2-opt): reverse tour[p..q] (or the shorter complement)
+	- node swap:             exchange the cities at positions i and j
+	- segment move:          take the L cities at positions i..i+L-1 out
+	                         and put them, forward or reversed, between
+	                         tour[k] and tour[k+1]. L <= 3 is Or-opt,
+	                         longer segments are 3-opt segment insertion.
+*/
+
+#include <stdlib.h>
+
+#include "distance.hpp"
+
+#ifndef SEGMAX
+	#define SEGMAX 50		// Longest segment moved by segment insertion
+#endif
+
+/* 2-opt: delta of reversing tour[p..q], p <= q */
+template<class D>
+inline float reverseDelta(const D &dist, const int *tour, int N, int p, int q) {
+	int p1 = (p - 1 + N) % N;
+	int q1 = (q + 1) % N;
+	int tp = tour[p], tq = tour[q], tp1 = tour[p1], tq1 = tour[q1];
+	return dist(tp, tq1) + dist(tp1, tq) - dist(tp, tp1) - dist(tq, tq1);
+}
+
+inline float reverseDelta(const int *tour, int N, int p, int q) {
+	return reverseDelta(DistAny(), tour, N, p, q);
+}
+
+/*
+	Reversing tour[p..q] and reversing its complement tour[q+1..p-1]
+	give the same cycle, so whichever is shorter gets reversed, with
+	wrap-around indexing. At most N/2 cities move.
+*/
+inline void applyReverse(int *tour, int *pos, int N, int p, int q) {
+	int len = q - p + 1;
+	if (2 * len > N) {
+		int np = q + 1;
+		q = p - 1 + N;
+		p = np;
+		len = N - len;
+	}
+	int tmp;
+	for (int k = 0; k < len / 2; ++k) {
+		int i = p + k, j = q - k;
+		if (i >= N)
+			i -= N;
+		if (j >= N)
+			j -= N;
+		tmp = tour[i];
+		tour[i] = tour[j];
+		tour[j] = tmp;
+	}
+	if (pos != NULL) {
+		for (int k = 0; k < len; ++k) {
+			int i = p + k;
+			if (i >= N)
+				i -= N;
+			pos[tour[i]] = i;
+		}
+	}
+}
+
+/* node swap: delta of exchanging tour[i] and tour[j], i != j */
+template<class D>
+inline float swapDelta(const D &dist, const int *tour, int N, int i, int j) {
+	if ((j + 1) % N == i) {
+		int t = i;
+		i = j;
+		j = t;
+	}
+	int a = tour[i], b = tour[j];
+	int pa = tour[(i - 1 + N) % N], nb = tour[(j + 1) % N];
+	if ((i + 1) % N == j) {
+		/* adjacent: pa a b nb -> pa b a nb */
+		return dist(pa, b) + dist(a, nb) - dist(pa, a) - dist(b, nb);
+	}
+	int na = tour[(i + 1) % N], pb = tour[(j - 1 + N) % N];
+	return dist(pa, b) + dist(b, na) + dist(pb, a) + dist(a, nb)
+		- dist(pa, a) - dist(a, na) - dist(pb, b) - dist(b, nb);
+}
+
+inline float swapDelta(const int *tour, int N, int i, int j) {
+	return swapDelta(DistAny(), tour, N, i, j);
+}
+
+inline void applySwap(int *tour, int *pos, int i, int j) {
+	int tmp = tour[i];
+	tour[i] = tour[j];
+	tour[j] = tmp;
+	if (pos != NULL) {
+		pos[tour[i]] = i;
+		pos[tour[j]] = j;
+	}
+}
+
+/*
+	segment move: delta of moving tour[i..i+L-1] between tour[k] and
+	tour[k+1]. k must lie outside [i-1, i+L-1]. The cheaper orientation
+	is chosen and returned in rev.
+*/
+template<class D>
+inline float segmentDelta(const D &dist, const int *tour, int N, int i, int L, int k, bool &rev) {
+	int s1 = tour[i], sL = tour[(i + L - 1) % N];
+	int p = tour[(i - 1 + N) % N], nx = tour[(i + L) % N];
+	int c = tour[k], d = tour[(k + 1) % N];
+	float removed = dist(p, nx) - dist(p, s1) - dist(sL, nx) - dist(c, d);
+	float fwd = dist(c, s1) + dist(sL, d);
+	float bwd = dist(c, sL) + dist(s1, d);
+	rev = bwd < fwd;
+	return removed + (rev ? bwd : fwd);
+}
+
+inline float segmentDelta(const int *tour, int N, int i, int L, int k, bool &rev) {
+	return segmentDelta(DistAny(), tour, N, i, L, k, rev);
+}
+
+/*
+	The tour reads S X Y from position i (S the segment, X ends with c,
+	Y starts with d) and becomes X S Y. Either X is shifted left over S
+	or Y is shifted right over it, whichever is shorter.
+*/
+void applySegment(int *tour, int *pos, int N, int i, int L, int k, bool rev) {
+	int buf[SEGMAX];
+	for (int t = 0; t < L; ++t)
+		buf[t] = tour[(i + (rev ? L - 1 - t : t)) % N];
+	int rk = (k - i + N) % N;		// c relative to i, L <= rk <= N-2
+	int lenX = rk - L + 1;
+	int lenY = N - 1 - rk;
+	int from, to;					// relative range rewritten
+	if (lenX <= lenY) {
+		for (int t = 0; t < lenX; ++t)
+			tour[(i + t) % N] = tour[(i + L + t) % N];
+		for (int t = 0; t < L; ++t)
+			tour[(i + lenX + t) % N] = buf[t];
+		from = 0;
+		to = rk;
+	}
+	else {
+		for (int t = N - 1; t > rk; --t)
+			tour[(i + t + L) % N] = tour[(i + t) % N];
+		for (int t = 0; t < L; ++t)
+			tour[(i + rk + 1 + t) % N] = buf[t];
+		from = rk + 1;
+		to = N - 1 + L;
+	}
+	if (pos != NULL) {
+		for (int t = from; t <= to; ++t)
+			pos[tour[(i + t) % N]] = (i + t) % N;
+	}
+}
+
+#endif /* UTILS_MOVES_HPP_ */
@@ -0,0 +1,136 @@
+#ifndef UTILS_NEIGHBORS_HPP_
+#define UTILS_NEIGHBORS_HPP_
+
+/*
+	K-nearest-neighbor candidate lists
+
+	candList[c*candK .. c*candK+candK-1] are the candK cities closest to
+	city c, nearest first. EUC_2D instances are bucketed into a uniform
+	grid (about 2 cities per cell) and searched ring by ring, which is
+	O(n*K) in practice. EXPLICIT instances use a partial sort of each row
+	of the matrix, O(n^2).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "distance.hpp"
+
+int candK = 0;				// candidates per city, 0 = no lists
+int *candList = NULL;		// n*candK
+
+/* insert (d, c) into the sorted top-k list (bestD, bestC) of size cnt */
+inline void knnInsert(float *bestD, int *bestC, int &cnt, int k, float d, int c) {
+	if (cnt == k && d >= bestD[k - 1])
+		return;
+	int i = (cnt < k) ? cnt++ : k - 1;
+	while (i > 0 && bestD[i - 1] > d) {
+		bestD[i] = bestD[i - 1];
+		bestC[i] = bestC[i - 1];
+		--i;
+	}
+	bestD[i] = d;
+	bestC[i] = c;
+}
+
+/* grid search on the coordinates, squared distances */
+void buildNeighborsGrid(int n, int k, const float *x, const float *y, int *lists) {
+	float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < n; ++i) {
+		minX = std::min(minX, x[i]);
+		maxX = std::max(maxX, x[i]);
+		minY = std::min(minY, y[i]);
+		maxY = std::max(maxY, y[i]);
+	}
+	int g = (int)sqrt(n / 2.0) + 1;		// g*g cells
+	float cw = (maxX - minX) / g + 1e-6f, ch = (maxY - minY) / g + 1e-6f;
+	float cellMin = std::min(cw, ch);
+	int *cellOf = (int *)malloc(sizeof(int) * n);
+	int *cellStart = (int *)calloc(g * g + 1, sizeof(int));
+	int *cellItem = (int *)malloc(sizeof(int) * n);
+	for (int i = 0; i < n; ++i) {
+		int cx = std::min((int)((x[i] - minX) / cw), g - 1);
+		int cy = std::min((int)((y[i] - minY) / ch), g - 1);
+		cellOf[i] = cy * g + cx;
+		cellStart[cellOf[i] + 1]++;
+	}
+	for (int c = 0; c < g * g; ++c)
+		cellStart[c + 1] += cellStart[c];
+	int *fill = (int *)malloc(sizeof(int) * g * g);
+	memcpy(fill, cellStart, sizeof(int) * g * g);
+	for (int i = 0; i < n; ++i)
+		cellItem[fill[cellOf[i]]++] = i;
+	free(fill);
+
+	float *bestD = (float *)malloc(sizeof(float) * k);
+	for (int i = 0; i < n; ++i) {
+		int cx = cellOf[i] % g, cy = cellOf[i] / g;
+		int cnt = 0;
+		for (int r = 0; r < g; ++r) {
+			/* visit the cells at Chebyshev distance r from (cx, cy) */
+			for (int yy = cy - r; yy <= cy + r; ++yy) {
+				if (yy < 0 || yy >= g)
+					continue;
+				int step = (yy == cy - r || yy == cy + r) ? 1 : 2 * r;
+				for (int xx = cx - r; xx <= cx + r; xx += step) {
+					if (xx < 0 || xx >= g)
+						continue;
+					int c = yy * g + xx;
+					for (int t = cellStart[c]; t < cellStart[c + 1]; ++t) {
+						int j = cellItem[t];
+						if (j == i)
+							continue;
+						float dx = x[i] - x[j], dy = y[i] - y[j];
+						knnInsert(bestD, &lists[(size_t)i * k], cnt, k, dx * dx + dy * dy, j);
+					}
+				}
+			}
+			/* anything in ring r+1 is at least r*cellMin away */
+			float reach = r * cellMin;
+			if (cnt == k && bestD[k - 1] <= reach * reach)
+				break;
+		}
+	}
+	free(bestD);
+	free(cellOf);
+	free(cellStart);
+	free(cellItem);
+}
+
+/* partial sort of every row of getDist() */
+void buildNeighborsMatrix(int n, int k, int *lists) {
+	float *bestD = (float *)malloc(sizeof(float) * k);
+	for (int i = 0; i < n; ++i) {
+		int cnt = 0;
+		for (int j = 0; j < n; ++j) {
+			if (j != i)
+				knnInsert(bestD, &lists[(size_t)i * k], cnt, k, getDist(i, j), j);
+		}
+	}
+	free(bestD);
+}
+
+/* n*k lists for the loaded instance, k <= n-1, caller frees */
+int *newNeighbors(int k) {
+	int n = distN;
+	int *lists = (int *)malloc(sizeof(int) * (size_t)n * k);
+	if (distX != NULL)
+		buildNeighborsGrid(n, k, distX, distY, lists);
+	else
+		buildNeighborsMatrix(n, k, lists);
+	return lists;
+}
+
+/* build candidate lists of size k for the loaded instance */
+void buildNeighbors(int k) {
+	int n = distN;
+	if (k > n - 1)
+		k = n - 1;
+	candK = k;
+	free(candList);
+	candList = newNeighbors(k);
+}
+
+#endif /* UTILS_NEIGHBORS_HPP_ */
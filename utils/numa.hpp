@@ -0,0 +1,181 @@
+#ifndef UTILS_NUMA_HPP_
+#define UTILS_NUMA_HPP_
+
+/*
+	NUMA replicas of the distance data
+
+	The matrix (or the coordinates) is first touched by the loading
+	thread, so on a multi-socket box every thread on the other sockets
+	reads it across the interconnect, and the hot loop is nothing but
+	distance lookups. With --numa the read-only arrays getDist() uses are
+	copied once per node:
+	  - the nodes and their CPUs come from /sys/devices/system/node (no
+	    libnuma needed): every id in node/online, so sparse ids work,
+	    and nodes without CPUs (memory-only, CXL / HBM) get no copy
+	  - each copy is made by a helper thread pinned to the node, so first
+	    touch places its pages there
+	  - copies are mmap()ed with MADV_HUGEPAGE, a 1000-city matrix is then
+	    2 TLB entries instead of 1000
+	numaBindThread() points the calling thread's distLocal at the copy of
+	the node it runs on; call it whenever a task starts, threads are not
+	pinned and may move. A one-node machine gets the huge page copy only.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "options.hpp"
+#include "distance.hpp"
+#include "pool.hpp"
+
+#define NUMA_MAXCPU CPU_SETSIZE
+#define NUMA_MAXNODE 64
+#define HUGE_PAGE (2 << 20)
+
+int numaNodes = 0;				// replicas made, 0: --numa is off
+int numaIds = 0;				// entries in numaReplica, highest node id + 1
+int *numaCpuNode = NULL;		// node id of each cpu
+DistData *numaReplica = NULL;	// by node id, empty for nodes without cpus
+
+/* memory for size bytes on huge pages where the kernel has them, zeroed */
+void *hugeAlloc(size_t size) {
+	size = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Cannot map %zu bytes!\n", size);
+		exit(1);
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+void hugeFree(void *p, size_t size) {
+	if (p != NULL)
+		munmap(p, (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE);
+}
+
+/* parse a cpulist such as "0-3,8-11" into set, false if there is none */
+bool numaReadCpus(int node, cpu_set_t &set) {
+	char path[128], buf[4096];
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return false;
+	bool ok = (fgets(buf, sizeof(buf), f) != NULL);
+	fclose(f);
+	CPU_ZERO(&set);
+	int cpus[NUMA_MAXCPU];
+	int cnt = ok ? parseCpuList(buf, cpus, NUMA_MAXCPU) : 0;
+	for (int k = 0; k < cnt; ++k)
+		CPU_SET(cpus[k], &set);
+	return cnt > 0;
+}
+
+struct NumaCopy {
+	int node;
+	cpu_set_t cpus;
+};
+
+/* runs pinned to the node, so the copy is first touched there */
+void *numaCopyMain(void *arg) {
+	NumaCopy *c = (NumaCopy *)arg;
+	sched_setaffinity(0, sizeof(cpu_set_t), &c->cpus);
+	DistData &r = numaReplica[c->node];
+	if (distMode != DIST_COORD) {
+		size_t bytes = distCount * distEntrySize();
+		void *m = hugeAlloc(bytes);
+		const void *src = (distType == DTYPE_U16) ? (const void *)distU16 : (const void *)distMatrix;
+		memcpy(m, src, bytes);
+		r.matrix = (distType == DTYPE_FLOAT) ? (float *)m : NULL;
+		r.u16 = (distType == DTYPE_U16) ? (uint16_t *)m : NULL;
+	}
+	if (distX != NULL) {
+		r.x = (float *)hugeAlloc(sizeof(float) * distN);
+		r.y = (float *)hugeAlloc(sizeof(float) * distN);
+		memcpy(r.x, distX, sizeof(float) * distN);
+		memcpy(r.y, distY, sizeof(float) * distN);
+	}
+	return NULL;
+}
+
+/* read --numa and make the replicas, call after initDistance() */
+void initNuma() {
+	if (optionValue("numa", NULL) == NULL)
+		return;
+	/* node ids are listed like cpus, e.g. "0-1,4" */
+	int ids[NUMA_MAXNODE], cnt = 0;
+	char buf[4096];
+	FILE *f = fopen("/sys/devices/system/node/online", "r");
+	if (f != NULL) {
+		if (fgets(buf, sizeof(buf), f) != NULL)
+			cnt = parseCpuList(buf, ids, NUMA_MAXNODE);
+		fclose(f);
+	}
+	NumaCopy *copies = new NumaCopy[NUMA_MAXNODE];
+	for (int k = 0; k < cnt; ++k) {
+		if (numaReadCpus(ids[k], copies[numaNodes].cpus))
+			copies[numaNodes++].node = ids[k];
+	}
+	if (numaNodes == 0) {		// no /sys: one node with every cpu
+		numaNodes = 1;
+		copies[0].node = 0;
+		sched_getaffinity(0, sizeof(cpu_set_t), &copies[0].cpus);
+	}
+	for (int k = 0; k < numaNodes; ++k)
+		numaIds = (copies[k].node + 1 > numaIds) ? copies[k].node + 1 : numaIds;
+	numaCpuNode = (int *)malloc(sizeof(int) * NUMA_MAXCPU);
+	for (int c = 0; c < NUMA_MAXCPU; ++c)
+		numaCpuNode[c] = copies[0].node;		// cpus no node lists
+	numaReplica = (DistData *)calloc(numaIds, sizeof(DistData));
+	pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * numaNodes);
+	for (int k = 0; k < numaNodes; ++k) {
+		for (int c = 0; c < NUMA_MAXCPU; ++c) {
+			if (CPU_ISSET(c, &copies[k].cpus))
+				numaCpuNode[c] = copies[k].node;
+		}
+		if (pthread_create(&threads[k], NULL, numaCopyMain, &copies[k])) {
+			fprintf(stderr, "Fail to create thread! %d\n", k);
+			exit(1);
+		}
+	}
+	for (int k = 0; k < numaNodes; ++k)
+		pthread_join(threads[k], NULL);
+	free(threads);
+	delete[] copies;
+	printf("NUMA: %d node(s), %zu bytes of distance data each\n", numaNodes,
+			(distMode != DIST_COORD ? distCount * distEntrySize() : 0) + (distX != NULL ? 2 * sizeof(float) * distN : 0));
+}
+
+/* point the calling thread at the replica of the node it runs on */
+inline void numaBindThread() {
+	if (numaNodes == 0)
+		return;
+	int cpu = sched_getcpu();
+	distLocal = &numaReplica[numaCpuNode[(cpu >= 0 && cpu < NUMA_MAXCPU) ? cpu : 0]];
+}
+
+void freeNuma() {
+	for (int k = 0; k < numaIds; ++k) {
+		DistData &r = numaReplica[k];
+		size_t bytes = distCount * distEntrySize();
+		hugeFree(r.matrix, bytes);
+		hugeFree(r.u16, bytes);
+		hugeFree(r.x, sizeof(float) * distN);
+		hugeFree(r.y, sizeof(float) * distN);
+	}
+	free(numaReplica);
+	free(numaCpuNode);
+	numaReplica = NULL;
+	numaCpuNode = NULL;
+	numaNodes = 0;
+	numaIds = 0;
+	distLocal = &distHome;
+}
+
+#endif /* UTILS_NUMA_HPP_ */
@@ -0,0 +1,71 @@
+#ifndef UTILS_OPTIONS_HPP_
+#define UTILS_OPTIONS_HPP_
+
+/*
+	Command line options shared by all binaries
+
+	Options are written as "--name=value" (or "--name" for a flag) and may
+	appear anywhere on the command line. parseOptions() removes them from
+	argv, so the positional arguments keep their old meaning (argv[1] is
+	still the .tsp file, ...).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define MAXOPTIONS 64
+
+struct OptionEntry {
+	const char *name;
+	int nameLen;
+	const char *value;
+};
+
+OptionEntry optionTable[MAXOPTIONS];
+int optionCnt = 0;
+
+/* strip the "--name[=value]" arguments out of argv, return the new argc */
+int parseOptions(int argc, char **argv) {
+	int k = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strncmp(argv[i], "--", 2) != 0 || argv[i][2] == '\0') {
+			argv[k++] = argv[i];
+			continue;
+		}
+		if (optionCnt == MAXOPTIONS) {
+			fprintf(stderr, "Too many options!\n");
+			exit(1);
+		}
+		const char *name = argv[i] + 2;
+		const char *eq = strchr(name, '=');
+		OptionEntry &e = optionTable[optionCnt++];
+		e.name = name;
+		e.nameLen = eq ? (int)(eq - name) : (int)strlen(name);
+		e.value = eq ? eq + 1 : "1";
+	}
+	argv[k] = NULL;
+	return k;
+}
+
+/* the value of the last "--name=..." given, or def */
+const char *optionValue(const char *name, const char *def) {
+	int len = strlen(name);
+	for (int i = optionCnt - 1; i >= 0; --i) {
+		if (optionTable[i].nameLen == len && strncmp(optionTable[i].name, name, len) == 0)
+			return optionTable[i].value;
+	}
+	return def;
+}
+
+inline long optionInt(const char *name, long def) {
+	const char *v = optionValue(name, NULL);
+	return v ? strtol(v, NULL, 0) : def;
+}
+
+inline double optionDouble(const char *name, double def) {
+	const char *v = optionValue(name, NULL);
+	return v ? strtod(v, NULL) : def;
+}
+
+#endif /* UTILS_OPTIONS_HPP_ */
@@ -0,0 +1,277 @@
+#ifndef UTILS_POOL_HPP_
+#define UTILS_POOL_HPP_
+
+/*
+	Work-stealing task pool
+
+	Every worker owns a deque: it pushes and pops its own tasks at the
+	back (LIFO, the continuation it just queued stays hot) and, when it
+	runs dry, steals the oldest task from the front of another worker's
+	deque. A task is a plain function + argument and may submit more
+	tasks, e.g. its own continuation.
+
+	Two ways to run the workers:
+	  start() / wait() / stop()   nprocess pthreads owned by the pool
+	  drain(id)                   an external team (OpenMP threads) calls
+	                              it with ids 0..n-1, it returns once
+	                              every submitted task has finished
+
+	With --cpus=LIST (e.g. 0-15,32-47, see initPinning()) worker id is
+	pinned to the (id mod count)-th cpu of the list, so it keeps its
+	caches and its NUMA node.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <deque>
+#include <atomic>
+
+#include "options.hpp"
+
+#define POOL_MAXCPU 4096
+
+typedef void (*TaskFn)(void *arg);
+
+struct Task {
+	TaskFn fn;
+	void *arg;
+};
+
+static __thread int poolSelf = -1;	// worker id of the calling thread, -1 outside the pool
+
+int *pinCpus = NULL;		// --cpus, NULL: threads float
+int pinCnt = 0;
+
+/* cpus of a list such as "0-3,8-11" in order into cpus[max], returns how many */
+int parseCpuList(const char *list, int *cpus, int max) {
+	int cnt = 0;
+	char *p = (char *)list;
+	while (*p >= '0' && *p <= '9') {
+		int lo = strtol(p, &p, 10), hi = lo;
+		if (*p == '-')
+			hi = strtol(p + 1, &p, 10);
+		for (int c = lo; c <= hi && cnt < max; ++c)
+			cpus[cnt++] = c;
+		if (*p == ',')
+			++p;
+	}
+	return cnt;
+}
+
+/* read --cpus */
+void initPinning() {
+	const char *list = optionValue("cpus", NULL);
+	if (list == NULL)
+		return;
+	pinCpus = (int *)malloc(sizeof(int) * POOL_MAXCPU);
+	pinCnt = parseCpuList(list, pinCpus, POOL_MAXCPU);
+	if (pinCnt == 0) {
+		fprintf(stderr, "Bad cpu list: %s\n", list);
+		exit(1);
+	}
+}
+
+/* pin the calling thread, the id-th thread of a team, to its --cpus entry */
+void pinSelf(int id) {
+	if (pinCnt == 0)
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(pinCpus[id % pinCnt], &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+		fprintf(stderr, "Cannot pin thread %d to cpu %d!\n", id, pinCpus[id % pinCnt]);
+}
+
+class TaskPool {
+	public:
+		TaskPool(): n(0), queues(NULL), threads(NULL), pending(0), queued(0), stolen(0), stopping(false), nextQueue(0) {
+			pthread_mutex_init(&mutex, NULL);
+			pthread_cond_init(&workCond, NULL);
+			pthread_cond_init(&doneCond, NULL);
+		}
+
+		~TaskPool() {
+			stop();
+			delete[] queues;
+			pthread_mutex_destroy(&mutex);
+			pthread_cond_destroy(&workCond);
+			pthread_cond_destroy(&doneCond);
+		}
+
+		/* n deques, no threads yet */
+		void init(int _n) {
+			n = _n;
+			queues = new WorkQueue[n];
+		}
+
+		/* spawn one pthread per deque */
+		void start() {
+			threads = (pthread_t *)malloc(sizeof(pthread_t) * n);
+			for (int i = 0; i < n; ++i) {
+				WorkerArg *wa = new WorkerArg;
+				wa->pool = this;
+				wa->id = i;
+				if (pthread_create(&threads[i], NULL, workerMain, wa)) {
+					fprintf(stderr, "Fail to create thread! %d\n", i);
+					exit(1);
+				}
+			}
+		}
+
+		/* from a worker the task goes to its own deque, otherwise round robin */
+		void submit(TaskFn fn, void *arg) {
+			Task t = { fn, arg };
+			int q = (poolSelf >= 0) ? poolSelf : (nextQueue++ % n);
+			pending++;
+			queued++;
+			pthread_mutex_lock(&queues[q].lock);
+			queues[q].tasks.push_back(t);
+			pthread_mutex_unlock(&queues[q].lock);
+			pthread_mutex_lock(&mutex);
+			pthread_cond_signal(&workCond);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		/* block until every submitted task has finished */
+		void wait() {
+			pthread_mutex_lock(&mutex);
+			while (pending > 0)
+				pthread_cond_wait(&doneCond, &mutex);
+			pthread_mutex_unlock(&mutex);
+		}
+
+		/* run tasks as worker id until the pool is empty */
+		void drain(int id) {
+			work(id, true);
+		}
+
+		void stop() {
+			if (threads == NULL)
+				return;
+			pthread_mutex_lock(&mutex);
+			stopping = true;
+			pthread_cond_broadcast(&workCond);
+			pthread_mutex_unlock(&mutex);
+			for (int i = 0; i < n; ++i)
+				pthread_join(threads[i], NULL);
+			free(threads);
+			threads = NULL;
+			stopping = false;
+		}
+
+		int size() const {
+			return n;
+		}
+
+		long long steals() const {
+			return stolen;
+		}
+
+		/* worker id of the calling thread, -1 outside the pool */
+		static int self() {
+			return poolSelf;
+		}
+
+	private:
+		struct WorkQueue {
+			pthread_mutex_t lock;
+			std::deque<Task> tasks;
+			char pad[64];		// keep the locks of neighboring deques on different cache lines
+
+			WorkQueue() {
+				pthread_mutex_init(&lock, NULL);
+			}
+
+			~WorkQueue() {
+				pthread_mutex_destroy(&lock);
+			}
+		};
+
+		struct WorkerArg {
+			TaskPool *pool;
+			int id;
+		};
+
+		int n;
+		WorkQueue *queues;
+		pthread_t *threads;
+		std::atomic<int> pending;	// submitted and not finished
+		std::atomic<int> queued;	// sitting in a deque
+		std::atomic<long long> stolen;
+		bool stopping;
+		std::atomic<unsigned int> nextQueue;
+		pthread_mutex_t mutex;		// guards the sleeps below
+		pthread_cond_t workCond;	// a task was queued, or stop()
+		pthread_cond_t doneCond;	// pending dropped to 0
+
+		static void *workerMain(void *p) {
+			WorkerArg *wa = (WorkerArg *)p;
+			TaskPool *pool = wa->pool;
+			int id = wa->id;
+			delete wa;
+			pool->work(id, false);
+			return NULL;
+		}
+
+		/* own deque first (back), then steal (front) */
+		bool take(int id, Task &t) {
+			WorkQueue &own = queues[id];
+			pthread_mutex_lock(&own.lock);
+			if (!own.tasks.empty()) {
+				t = own.tasks.back();
+				own.tasks.pop_back();
+				pthread_mutex_unlock(&own.lock);
+				queued--;
+				return true;
+			}
+			pthread_mutex_unlock(&own.lock);
+			for (int k = 1; k < n; ++k) {
+				WorkQueue &victim = queues[(id + k) % n];
+				pthread_mutex_lock(&victim.lock);
+				if (!victim.tasks.empty()) {
+					t = victim.tasks.front();
+					victim.tasks.pop_front();
+					pthread_mutex_unlock(&victim.lock);
+					queued--;
+					stolen++;
+					return true;
+				}
+				pthread_mutex_unlock(&victim.lock);
+			}
+			return false;
+		}
+
+		void work(int id, bool untilEmpty) {
+			poolSelf = id;
+			pinSelf(id);
+			Task t;
+			while (true) {
+				if (take(id, t)) {
+					t.fn(t.arg);
+					if (--pending == 0) {
+						pthread_mutex_lock(&mutex);
+						pthread_cond_broadcast(&doneCond);
+						pthread_cond_broadcast(&workCond);
+						pthread_mutex_unlock(&mutex);
+					}
+					continue;
+				}
+				if (queued > 0) {
+					sched_yield();		// a task is being pushed right now
+					continue;
+				}
+				pthread_mutex_lock(&mutex);
+				while (queued == 0 && !stopping && !(untilEmpty && pending == 0))
+					pthread_cond_wait(&workCond, &mutex);
+				bool quit = (queued == 0) && (stopping || (untilEmpty && pending == 0));
+				pthread_mutex_unlock(&mutex);
+				if (quit)
+					break;
+			}
+			poolSelf = -1;
+		}
+};
+
+#endif /* UTILS_POOL_HPP_ */
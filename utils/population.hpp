@@ -0,0 +1,160 @@
+#ifndef UTILS_POPULATION_HPP_
+#define UTILS_POPULATION_HPP_
+
+/*
+	Population annealing over the thread pool
+
+	--population=R anneals R tours together instead of independent
+	restarts. At every temperature step T -> T' = ALPHA * T:
+	  - replica i is weighted by exp(-(1/T' - 1/T) * len_i) and the
+	    population is resampled back to R by systematic resampling, so
+	    short tours get copies and long ones die out
+	  - the copies are memcpy()ed into a second, pre-allocated set of
+	    tour slots, which then swaps places with the first. Every slot
+	    (and every replica's pos[]) is its own Arena piece, so replicas
+	    that run on different workers never share a cache line
+	  - every replica runs RELAX proposals at T' (chainRelax()), one pool
+	    task per replica, the tasks are independent until the next
+	    resampling
+	Replica slot j keeps Rng stream j and the resampling draws from
+	stream R, so the result depends on --seed only, not on the threads.
+	The run stops at STOPTEMP or once the best length has not moved for
+	MAXLAST steps, like saRunSteps(); the shortest tour seen is kept.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "anneal.hpp"
+#include "construct.hpp"
+#include "pool.hpp"
+#include "numa.hpp"
+#include "arena.hpp"
+
+struct alignas(CACHE_LINE) PaReplica {
+	SaChain chain;
+	Rng rng;
+	int src;				// slot of the last step this replica is copied from
+	int *slot;				// its tour in the new set
+};
+
+PaReplica *paRep = NULL;
+Arena *paArena = NULL;		// the tour slots and pos[] arrays
+int **paOld = NULL;			// tours of the last step, by replica
+float paTemp = 0;
+
+/* copy the replica's ancestor in, then one temperature step */
+void paStep(void *arg) {
+	PaReplica *r = (PaReplica *)arg;
+	numaBindThread();
+	memcpy(r->slot, paOld[r->src], sizeof(int) * distN);
+	r->chain.tour = r->slot;
+	chainReset(r->chain);
+	chainRelax(r->chain, paTemp, r->rng);
+	chainSync(r->chain);
+}
+
+/*
+	systematic resampling of the R replicas with weights
+	exp(-dBeta * (len - min)): one uniform u, replica i gets a copy for
+	every point u + k in its share of the cumulative weight, R in total
+*/
+void paResample(int R, double dBeta, Rng &rng) {
+	double minLen = paRep[0].chain.len;
+	for (int i = 1; i < R; ++i)
+		minLen = (paRep[i].chain.len < minLen) ? paRep[i].chain.len : minLen;
+	double *w = (double *)malloc(sizeof(double) * R);
+	double sum = 0;
+	for (int i = 0; i < R; ++i) {
+		w[i] = exp(-dBeta * (paRep[i].chain.len - minLen));
+		sum += w[i];
+	}
+	double step = sum / R, at = rng.uniform() * step, cum = 0;
+	int j = 0;
+	for (int i = 0; i < R && j < R; ++i) {
+		cum += w[i];
+		for (; j < R && at < cum; ++j, at += step)
+			paRep[j].src = i;
+	}
+	for (; j < R; ++j)			// rounding: the last replica fills up
+		paRep[j].src = R - 1;
+	free(w);
+}
+
+/*
+	population annealing of R replicas on pool, runPool(pool) runs the
+	queued tasks to the end. The shortest tour goes to best, returns its
+	length.
+*/
+float populationAnneal(TaskPool &pool, int R, void (*runPool)(TaskPool &), int *best) {
+	int N = distN;
+	if (R < 2) {
+		fprintf(stderr, "Bad population size: --population=R >= 2\n");
+		exit(1);
+	}
+	paRep = new PaReplica[R];
+	paOld = (int **)malloc(sizeof(int *) * R);
+	paArena = new Arena;
+	float t0 = INITEMP;
+	for (int i = 0; i < R; ++i) {
+		paRep[i].rng.seed(rngSeed, i);
+		paOld[i] = (int *)paArena->alloc(sizeof(int) * N);
+		paRep[i].slot = (int *)paArena->alloc(sizeof(int) * N);
+		if (buildTour(paOld[i], paRep[i].rng) && i == 0)
+			t0 = saStartTemp(paOld[i], paRep[i].rng);
+		chainInit(paRep[i].chain, paOld[i], paArena);
+		paRep[i].src = i;
+	}
+	Rng rng(rngSeed, R);
+	printf("Population annealing: %d replicas from T = %g\n", R, t0);
+
+	float bestLen = -1;
+	double lastLen = -1;
+	int steps = 0, same = 0;
+	long long moved = 0;		// replica steps that started from another tour
+	paTemp = t0;
+	while (paTemp > STOPTEMP && same < MAXLAST) {
+		float next = paTemp * ALPHA;
+		if (steps > 0)
+			paResample(R, 1.0 / next - 1.0 / paTemp, rng);
+		for (int i = 0; i < R; ++i)
+			moved += (paRep[i].src != i);
+		paTemp = next;
+		steps++;
+		for (int i = 0; i < R; ++i)
+			pool.submit(paStep, &paRep[i]);
+		runPool(pool);
+		/* the new set becomes the old one */
+		int mini = 0;
+		for (int i = 0; i < R; ++i) {
+			int *t = paOld[i];
+			paOld[i] = paRep[i].slot;
+			paRep[i].slot = t;
+			if (paRep[i].chain.len < paRep[mini].chain.len)
+				mini = i;
+		}
+		double len = paRep[mini].chain.len;
+		if (bestLen < 0 || len < bestLen) {
+			bestLen = len;
+			memcpy(best, paOld[mini], sizeof(int) * N);
+		}
+		same = (fabs(len - lastLen) < SAMELEN) ? same + 1 : 0;
+		lastLen = len;
+	}
+	printf("Population: %d steps, %lld of %lld replica steps resampled from another tour\n", steps, moved, (long long)steps * R);
+	for (int i = 0; i < R; ++i) {
+		paRep[i].chain.tour = paOld[i];
+		chainFree(paRep[i].chain);
+	}
+	free(paOld);
+	delete paArena;
+	delete[] paRep;
+	paRep = NULL;
+	paArena = NULL;
+	paOld = NULL;
+	return tourLen(best);
+}
+
+#endif /* UTILS_POPULATION_HPP_ */
@@ -0,0 +1,183 @@
+#ifndef UTILS_RENUMBER_HPP_
+#define UTILS_RENUMBER_HPP_
+
+/*
+	Locality-preserving city numbering
+
+	Cities keep their file order by default, so cities next to each other
+	in space sit far apart in the matrix rows and coordinate arrays. With
+	--renumber the instance is permuted once at load time:
+	  EUC_2D    cities sorted along a Hilbert curve
+	  EXPLICIT  reverse Cuthill-McKee on the RENUMBER_K nearest-neighbor
+	            graph, which puts close cities at close numbers
+	Then the endpoints of a short edge, and the cities of a neighbor
+	list, usually share a few cache lines of getDist(). Only the output
+	needs the file numbers back, see cityId() in distance.hpp.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+
+#include "tsplib.hpp"
+
+#ifndef RENUMBER_K
+	#define RENUMBER_K 8		// Neighbors per city in the RCM graph
+#endif
+
+/* position of (x, y) on the Hilbert curve through a side x side grid, side a power of 2 */
+uint64_t hilbertIndex(uint32_t side, uint32_t x, uint32_t y) {
+	uint64_t d = 0;
+	for (uint32_t s = side / 2; s > 0; s /= 2) {
+		uint32_t rx = (x & s) > 0;
+		uint32_t ry = (y & s) > 0;
+		d += (uint64_t)s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = side - 1 - x;
+				y = side - 1 - y;
+			}
+			uint32_t t = x;
+			x = y;
+			y = t;
+		}
+	}
+	return d;
+}
+
+/* order[k]: the k-th city by Hilbert index on a 2^16 grid over the bounding box */
+void hilbertOrder(const float *x, const float *y, int n, int *order) {
+	float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < n; ++i) {
+		minX = std::min(minX, x[i]);
+		maxX = std::max(maxX, x[i]);
+		minY = std::min(minY, y[i]);
+		maxY = std::max(maxY, y[i]);
+	}
+	float span = std::max(maxX - minX, maxY - minY) + 1e-6f;
+	std::pair<uint64_t, int> *key = new std::pair<uint64_t, int>[n];
+	for (int i = 0; i < n; ++i) {
+		uint32_t gx = (uint32_t)((x[i] - minX) / span * 65535.0f);
+		uint32_t gy = (uint32_t)((y[i] - minY) / span * 65535.0f);
+		key[i] = std::make_pair(hilbertIndex(65536, gx, gy), i);
+	}
+	std::sort(key, key + n);
+	for (int i = 0; i < n; ++i)
+		order[i] = key[i].second;
+	delete[] key;
+}
+
+/* order[k]: reverse Cuthill-McKee over the k-NN graph of the full n*n matrix w */
+void rcmOrder(const float *w, int n, int *order) {
+	int k = std::min(RENUMBER_K, n - 1);
+	/* symmetric k-NN graph as adjacency lists */
+	std::pair<float, int> *row = new std::pair<float, int>[n];
+	int *knn = (int *)malloc(sizeof(int) * (size_t)n * k);
+	int *deg = (int *)calloc(n, sizeof(int));
+	for (int i = 0; i < n; ++i) {
+		int m = 0;
+		for (int j = 0; j < n; ++j) {
+			if (j != i)
+				row[m++] = std::make_pair(w[(size_t)i * n + j], j);
+		}
+		std::partial_sort(row, row + k, row + m);
+		for (int t = 0; t < k; ++t) {
+			knn[(size_t)i * k + t] = row[t].second;
+			deg[i]++;
+			deg[row[t].second]++;
+		}
+	}
+	delete[] row;
+	int *start = (int *)malloc(sizeof(int) * (n + 1));
+	start[0] = 0;
+	for (int i = 0; i < n; ++i)
+		start[i + 1] = start[i] + deg[i];
+	int *adj = (int *)malloc(sizeof(int) * start[n]);
+	int *fill = (int *)malloc(sizeof(int) * n);
+	memcpy(fill, start, sizeof(int) * n);
+	for (int i = 0; i < n; ++i) {
+		for (int t = 0; t < k; ++t) {
+			int j = knn[(size_t)i * k + t];
+			adj[fill[i]++] = j;
+			adj[fill[j]++] = i;
+		}
+	}
+	free(knn);
+	free(fill);
+
+	/* Cuthill-McKee: BFS from a lowest-degree city, neighbors by increasing degree */
+	std::pair<int, int> *byDeg = new std::pair<int, int>[n];
+	for (int i = 0; i < n; ++i)
+		byDeg[i] = std::make_pair(deg[i], i);
+	std::sort(byDeg, byDeg + n);
+	char *seen = (char *)calloc(n, 1);
+	int len = 0;
+	for (int s = 0; s < n; ++s) {
+		int root = byDeg[s].second;
+		if (seen[root])
+			continue;		// next component
+		seen[root] = 1;
+		order[len++] = root;
+		for (int h = len - 1; h < len; ++h) {
+			int c = order[h];
+			int first = len;
+			for (int e = start[c]; e < start[c + 1]; ++e) {
+				if (!seen[adj[e]]) {
+					seen[adj[e]] = 1;
+					order[len++] = adj[e];
+				}
+			}
+			for (int a = first + 1; a < len; ++a) {		// insertion sort by degree, lists are short
+				int v = order[a], b = a;
+				for (; b > first && deg[order[b - 1]] > deg[v]; --b)
+					order[b] = order[b - 1];
+				order[b] = v;
+			}
+		}
+	}
+	std::reverse(order, order + n);
+	delete[] byDeg;
+	free(seen);
+	free(start);
+	free(adj);
+	free(deg);
+}
+
+/* inst with city order[k] renumbered to k, in place */
+void permuteInstance(TSPInstance &inst, const int *order) {
+	int n = inst.n;
+	if (inst.coordX != NULL) {
+		float *x = (float *)malloc(sizeof(float) * n);
+		float *y = (float *)malloc(sizeof(float) * n);
+		for (int i = 0; i < n; ++i) {
+			x[i] = inst.coordX[order[i]];
+			y[i] = inst.coordY[order[i]];
+		}
+		free(inst.coordX);
+		free(inst.coordY);
+		inst.coordX = x;
+		inst.coordY = y;
+	}
+	if (inst.weights != NULL) {
+		float *w = (float *)malloc(sizeof(float) * (size_t)n * n);
+		for (int i = 0; i < n; ++i) {
+			for (int j = 0; j < n; ++j)
+				w[(size_t)i * n + j] = inst.weights[(size_t)order[i] * n + order[j]];
+		}
+		free(inst.weights);
+		inst.weights = w;
+	}
+}
+
+/* the order --renumber uses for inst: Hilbert for EUC_2D, RCM for EXPLICIT */
+void renumberOrder(const TSPInstance &inst, int *order) {
+	if (inst.weightType == WEIGHT_EUC_2D)
+		hilbertOrder(inst.coordX, inst.coordY, inst.n, order);
+	else
+		rcmOrder(inst.weights, inst.n, order);
+}
+
+#endif /* UTILS_RENUMBER_HPP_ */
@@ -0,0 +1,380 @@
+#ifndef UTILS_RESTARTS_HPP_
+#define UTILS_RESTARTS_HPP_
+
+/*
+	Independent SA restarts as pool tasks
+
+	Restart i anneals a start tour (utils/construct.hpp, random unless
+	--init says otherwise) from Rng stream i, so the result only
+	depends on --seed, not on which worker runs which phase. A task runs
+	SA_PHASE temperature steps and then queues its own continuation: the
+	owner normally picks it straight back up, but an idle worker can steal
+	a queued run instead of sitting out the tail. Each phase reads the
+	distances from its worker's NUMA replica (utils/numa.hpp, --numa).
+	A restart is cache-line aligned and allocates its tour and scratch
+	from the arena of the worker that starts it (utils/arena.hpp), so
+	runs on different workers never share a line.
+
+	After every temperature step a run checks itself against the shared
+	incumbent (utils/incumbent.hpp) and gives up or reseeds when it is
+	hopeless.
+
+	--race=S races S restarts by successive halving: all of them anneal
+	for a round of temperature steps, the best --keep=F (default 0.5)
+	go on to the next round, the rest are dropped. Every round gets an
+	equal share of --budget=B temperature steps over all runs (default
+	MAXITER * RACE_STEPS), steps a finished run leaves unused roll over.
+	Once fewer runs survive than the pool has workers, the idle workers
+	get clones: a dropped run's slot takes a copy of a survivor's tour
+	and carries on from its temperature with a stream of its own. Clones
+	are ranked with the rest at the next cut, their steps come on top of
+	the budget.
+
+	--interleave=K queues the restarts in groups of K instead, a group
+	task anneals its members together (saRunGroupStep() in anneal.hpp).
+	K is capped so that every worker still gets a group.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "anneal.hpp"
+#include "construct.hpp"
+#include "pool.hpp"
+#include "incumbent.hpp"
+#include "numa.hpp"
+#include "arena.hpp"
+
+#ifndef SA_PHASE
+	#define SA_PHASE 50		// Temperature steps per task
+#endif
+#ifndef RACE_STEPS
+	#define RACE_STEPS 3000	// Temperature steps a restart typically needs to freeze
+#endif
+
+struct alignas(CACHE_LINE) RestartTask {
+	TaskPool *pool;
+	int idx;				// Rng stream
+	bool started;
+	int *tour;				// result of the restart
+	float len;				// -1 until finished
+	int quota;				// steps left before pausing, -1: no limit
+	float cloneTemp;		// --race clone: start temperature of the copied tour, 0: none
+	SaRun run;
+};
+
+/* --interleave: restarts that are queued as one task */
+struct RestartGroup {
+	TaskPool *pool;
+	int cnt;
+	RestartTask *member[INTERLEAVE_MAX];
+};
+
+Arena *restartArena = NULL;		// one per worker, and one for threads outside the pool
+int restartArenas = 0;
+int restartWidth = 1;				// restarts per task
+RestartGroup *restartGroup = NULL;	// the groups queued last
+
+/* the arena of the calling thread */
+inline Arena &workerArena() {
+	int self = TaskPool::self();
+	return restartArena[(self >= 0 && self < restartArenas - 1) ? self : restartArenas - 1];
+}
+
+/* compare run r with the records after its last step, true once it has stopped */
+bool restartCheck(RestartTask *r) {
+	SaRun &run = r->run;
+	float len = run.chain.len;
+	/* records are kept per temperature, runs may start below INITEMP */
+	int tstep = (int)(log(run.temperature / INITEMP) / log(ALPHA) + 0.5);
+	float best = incumbent.record(tstep, len);
+	if (len < incumbent.length()) {
+		chainSync(run.chain);
+		incumbent.publish(r->tour, len);
+	}
+	if (abandonMargin <= 0 || run.temperature >= abandonTemp || len <= best * (1 + abandonMargin))
+		return false;
+	abandoned++;
+	if (!abandonReseed) {
+		saRunStop(run);
+		return true;
+	}
+	/* carry on from the incumbent at the current temperature */
+	if (incumbent.length() < len) {
+		incumbent.read(r->tour);
+		chainReset(run.chain);
+		run.lastLen = run.chain.len;
+		run.contCnt = 0;
+	}
+	return false;
+}
+
+/* build the start tour of r on the calling worker */
+void restartStart(RestartTask *r) {
+	Rng rng(rngSeed, r->idx);	// one stream per restart
+	Arena &arena = workerArena();
+	float t0 = r->cloneTemp;
+	if (t0 <= 0) {
+		r->tour = (int *)arena.alloc(sizeof(int) * distN);
+		t0 = buildTour(r->tour, rng) ? saStartTemp(r->tour, rng) : INITEMP;
+	}
+	saRunInit(r->run, r->tour, rng, t0, &arena);
+	r->started = true;
+}
+
+/* r has stopped: record its result */
+void restartDone(RestartTask *r) {
+	r->len = tourLen(r->tour);
+	incumbent.publish(r->tour, r->len);
+}
+
+void restartPhase(void *arg) {
+	RestartTask *r = (RestartTask *)arg;
+	numaBindThread();
+	if (!r->started)
+		restartStart(r);
+	int steps = SA_PHASE;
+	if (r->quota >= 0 && r->quota < steps)
+		steps = r->quota;
+	bool done = false;
+	int s;
+	for (s = 0; s < steps && !done; ++s)
+		done = saRunSteps(r->run, 1) || restartCheck(r);
+	if (r->quota >= 0)
+		r->quota -= s;
+	if (done)
+		restartDone(r);
+	else if (r->quota != 0)
+		r->pool->submit(restartPhase, r);
+}
+
+/* SA_PHASE interleaved steps of the group's members that are still running */
+void groupPhase(void *arg) {
+	RestartGroup *g = (RestartGroup *)arg;
+	numaBindThread();
+	for (int k = 0; k < g->cnt; ++k) {
+		if (!g->member[k]->started)
+			restartStart(g->member[k]);
+	}
+	RestartTask *live[INTERLEAVE_MAX];
+	SaRun *runs[INTERLEAVE_MAX];
+	int nlive = 0;
+	for (int k = 0; k < g->cnt; ++k) {
+		RestartTask *r = g->member[k];
+		if (r->len < 0 && r->quota != 0)
+			live[nlive++] = r;
+	}
+	for (int s = 0; s < SA_PHASE && nlive > 0; ++s) {
+		for (int k = 0; k < nlive; ++k)
+			runs[k] = &live[k]->run;
+		saRunGroupStep(runs, nlive);
+		for (int k = 0; k < nlive; ) {
+			RestartTask *r = live[k];
+			bool done = r->run.done || restartCheck(r);
+			if (r->quota > 0)
+				r->quota--;
+			if (done)
+				restartDone(r);
+			if (done || r->quota == 0)
+				live[k] = live[--nlive];
+			else
+				++k;
+		}
+	}
+	if (nlive > 0)
+		g->pool->submit(groupPhase, g);
+}
+
+/* restarts per task for cnt restarts, from --interleave */
+int restartGroupWidth(TaskPool &pool, int cnt) {
+	if (saInterleave == 0)		// once, later calls reuse it
+		saInterleave = (tourMode == TOUR_ARRAY) ? saCalibrateInterleave() : 1;
+	int k = saInterleave;
+	int fair = cnt / pool.size();
+	if (k > fair)
+		k = (fair > 1) ? fair : 1;
+	return k;
+}
+
+/* queue the cnt restarts in rs, in groups of restartWidth */
+void queueRestarts(TaskPool &pool, RestartTask **rs, int cnt) {
+	if (restartWidth <= 1) {
+		for (int i = 0; i < cnt; ++i)
+			pool.submit(restartPhase, rs[i]);
+		return;
+	}
+	delete[] restartGroup;		// the last ones have finished
+	int groups = (cnt + restartWidth - 1) / restartWidth;
+	restartGroup = new RestartGroup[groups];
+	for (int i = 0; i < groups; ++i) {
+		RestartGroup &g = restartGroup[i];
+		g.pool = &pool;
+		g.cnt = 0;
+		for (int j = i * restartWidth; j < cnt && j < (i + 1) * restartWidth; ++j)
+			g.member[g.cnt++] = rs[j];
+		pool.submit(groupPhase, &g);
+	}
+}
+
+/* cnt restarts, none queued yet */
+RestartTask *newRestarts(TaskPool &pool, int cnt) {
+	RestartTask *rs = new RestartTask[cnt];
+	initIncumbent(distN);
+	restartArenas = pool.size() + 1;
+	restartArena = new Arena[restartArenas];
+	for (int i = 0; i < cnt; ++i) {
+		rs[i].pool = &pool;
+		rs[i].idx = i;
+		rs[i].started = false;
+		rs[i].tour = NULL;				// from the arena of the first worker
+		rs[i].len = -1;
+		rs[i].quota = -1;
+		rs[i].cloneTemp = 0;
+	}
+	return rs;
+}
+
+/* end a paused restart where it is */
+void finishRestart(RestartTask &r) {
+	if (r.len >= 0)
+		return;
+	saRunStop(r.run);
+	restartDone(&r);
+}
+
+/* current length, for ranking */
+inline float restartLen(const RestartTask *r) {
+	return (r->len >= 0) ? r->len : r->run.chain.len;
+}
+
+bool restartShorter(const RestartTask *a, const RestartTask *b) {
+	return restartLen(a) < restartLen(b);
+}
+
+/* queue cnt restarts on pool, the results are valid after the pool drained */
+RestartTask *submitRestarts(TaskPool &pool, int cnt) {
+	RestartTask *rs = newRestarts(pool, cnt);
+	RestartTask **all = (RestartTask **)malloc(sizeof(RestartTask *) * cnt);
+	for (int i = 0; i < cnt; ++i)
+		all[i] = &rs[i];
+	restartWidth = restartGroupWidth(pool, cnt);
+	queueRestarts(pool, all, cnt);
+	free(all);
+	return rs;
+}
+
+/*
+	turn the finished restart c into a copy of the paused restart from,
+	it starts over on the worker that picks it up (restartStart())
+*/
+void cloneRestart(RestartTask &c, RestartTask &from, int idx) {
+	chainSync(from.run.chain);
+	memcpy(c.tour, from.tour, sizeof(int) * distN);
+	c.idx = idx;
+	c.started = false;
+	c.len = -1;
+	c.cloneTemp = from.run.temperature;
+}
+
+/*
+	successive halving over starts restarts (see above), runPool(pool)
+	runs the queued tasks to the end. Returns the restarts for
+	bestRestart(), all of them finished.
+*/
+RestartTask *raceRestarts(TaskPool &pool, int starts, void (*runPool)(TaskPool &)) {
+	long long budget = optionInt("budget", MAXITER * RACE_STEPS);
+	float keep = optionDouble("keep", 0.5);
+	if (starts < 1 || budget < 1 || keep <= 0 || keep >= 1) {
+		fprintf(stderr, "Bad race options!\n");
+		exit(1);
+	}
+	int rounds = 1;
+	for (double alive = starts; alive > 1; alive = ceil(alive * keep))
+		rounds++;
+	printf("Race: %d starts, keep %g per round, %d rounds, budget %lld steps\n", starts, keep, rounds, budget);
+
+	RestartTask *rs = newRestarts(pool, starts);
+	RestartTask **alive = (RestartTask **)malloc(sizeof(RestartTask *) * starts);
+	RestartTask **queue = (RestartTask **)malloc(sizeof(RestartTask *) * starts);
+	for (int i = 0; i < starts; ++i)
+		alive[i] = &rs[i];
+	int nalive = starts;
+	int ranked = starts;		// runs the budget is shared by, the rest are clones
+	int clones = 0;
+	long long left = budget;
+	for (int r = 0; r < rounds && left > 0; ++r) {
+		int quota = (int)(left / ((long long)(rounds - r) * ranked));
+		if (quota < 1)
+			quota = 1;
+		long long before = 0, after = 0;
+		int queued = 0;
+		for (int i = 0; i < nalive; ++i) {
+			if (i < ranked)
+				before += alive[i]->started ? alive[i]->run.step : 0;
+			if (alive[i]->len < 0) {
+				alive[i]->quota = quota;
+				queue[queued++] = alive[i];
+			}
+		}
+		restartWidth = restartGroupWidth(pool, queued);
+		queueRestarts(pool, queue, queued);
+		runPool(pool);
+		for (int i = 0; i < ranked; ++i)
+			after += alive[i]->run.step;
+		left -= after - before;
+		std::sort(alive, alive + nalive, restartShorter);
+		printf("Round %d: %d runs (%d clones) x %d steps, best %f\n", r, nalive, nalive - ranked, quota, restartLen(alive[0]));
+		int next = (int)ceil(ranked * keep);
+		for (int i = next; i < nalive; ++i)
+			finishRestart(*alive[i]);
+		ranked = nalive = next;
+		/* idle workers next round: clone the survivors that still run */
+		int running = 0;
+		for (int i = 0; i < next; ++i)
+			running += (alive[i]->len < 0);
+		if (running == 0 || r + 1 >= rounds || left <= 0)
+			continue;
+		for (int i = 0, k = 0; i < starts && nalive < pool.size(); ++i) {
+			RestartTask *c = &rs[i];
+			for (int j = 0; j < nalive; ++j) {
+				if (alive[j] == c)
+					c = NULL;
+			}
+			if (c == NULL || c->tour == NULL)
+				continue;
+			while (alive[k % next]->len >= 0)
+				++k;
+			cloneRestart(*c, *alive[k++ % next], starts + clones++);
+			alive[nalive++] = c;
+		}
+	}
+	for (int i = 0; i < nalive; ++i)
+		finishRestart(*alive[i]);
+	free(alive);
+	free(queue);
+	return rs;
+}
+
+/* copy the shortest tour to best and release the restarts */
+float bestRestart(RestartTask *rs, int cnt, int *best) {
+	int minidx = 0;
+	for (int i = 1; i < cnt; ++i) {
+		if (rs[i].len < rs[minidx].len)
+			minidx = i;
+	}
+	float len = rs[minidx].len;
+	for (int j = 0; j < distN; ++j)
+		best[j] = rs[minidx].tour[j];
+	delete[] rs;
+	delete[] restartGroup;
+	restartGroup = NULL;
+	delete[] restartArena;
+	restartArena = NULL;
+	restartArenas = 0;
+	return len;
+}
+
+#endif /* UTILS_RESTARTS_HPP_ */
@@ -0,0 +1,143 @@
+#ifndef UTILS_RNG_HPP_
+#define UTILS_RNG_HPP_
+
+/*
+	Random numbers: xoshiro256** (Blackman & Vigna)
+
+	Every Rng is independent, so threads never share one and need no
+	locks. A generator is seeded with (seed, stream): the drivers use the
+	restart index as the stream, which makes a run depend only on --seed
+	and not on how restarts are scheduled over threads.
+
+	  --seed=S     seed of the run (default: taken from the clock)
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "options.hpp"
+
+class Rng {
+	public:
+		Rng() {
+			seed(0, 0);
+		}
+
+		Rng(uint64_t s, uint64_t stream) {
+			seed(s, stream);
+		}
+
+		/* fill the state with splitmix64, started from seed + a hash of stream */
+		void seed(uint64_t s, uint64_t stream) {
+			uint64_t x = s + mix64(stream + 1);
+			for (int i = 0; i < 4; ++i) {
+				x += 0x9E3779B97F4A7C15ULL;
+				st[i] = mix64(x);
+			}
+		}
+
+		inline uint64_t next() {
+			uint64_t ret = rotl(st[1] * 5, 7) * 9;
+			uint64_t t = st[1] << 17;
+			st[2] ^= st[0];
+			st[3] ^= st[1];
+			st[1] ^= st[2];
+			st[0] ^= st[3];
+			st[2] ^= t;
+			st[3] = rotl(st[3], 45);
+			return ret;
+		}
+
+		inline uint32_t next32() {
+			return (uint32_t)(next() >> 32);
+		}
+
+		/*
+			uniform in [0, n), n > 0: Lemire's multiply-shift, the
+			modulo only runs in the rare rejection case
+		*/
+		inline uint32_t bounded(uint32_t n) {
+			uint64_t m = (uint64_t)next32() * n;
+			uint32_t l = (uint32_t)m;
+			if (l < n) {
+				uint32_t t = -n % n;
+				while (l < t) {
+					m = (uint64_t)next32() * n;
+					l = (uint32_t)m;
+				}
+			}
+			return (uint32_t)(m >> 32);
+		}
+
+		/* uniform in [0, 1) with 24 bits */
+		inline float uniform() {
+			return (float)(next() >> 40) * (1.0f / 16777216.0f);
+		}
+
+		/* uniform in (0, 1], safe for log() */
+		inline float uniformOpen() {
+			return (float)((next() >> 40) + 1) * (1.0f / 16777216.0f);
+		}
+
+		/* batch versions */
+		void fill(uint32_t *out, int cnt) {
+			for (int i = 0; i < cnt; ++i)
+				out[i] = next32();
+		}
+
+		void fillBounded(uint32_t *out, int cnt, uint32_t n) {
+			for (int i = 0; i < cnt; ++i)
+				out[i] = bounded(n);
+		}
+
+		void fillUniform(float *out, int cnt) {
+			for (int i = 0; i < cnt; ++i)
+				out[i] = uniform();
+		}
+
+		/* Fisher-Yates */
+		void shuffle(int *a, int n) {
+			for (int i = n - 1; i > 0; --i) {
+				int j = bounded(i + 1);
+				int tmp = a[i];
+				a[i] = a[j];
+				a[j] = tmp;
+			}
+		}
+
+	private:
+		uint64_t st[4];
+
+		static inline uint64_t rotl(uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+
+		static inline uint64_t mix64(uint64_t z) {
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			return z ^ (z >> 31);
+		}
+};
+
+uint64_t rngSeed = 0;		// --seed
+
+/* read --seed, call once after parseOptions() */
+uint64_t initRng() {
+	const char *v = optionValue("seed", NULL);
+	if (v != NULL) {
+		char *end;
+		rngSeed = strtoull(v, &end, 10);
+		if (*v == '\0' || *end != '\0') {
+			fprintf(stderr, "Bad seed: %s\n", v);
+			exit(1);
+		}
+	}
+	else
+		rngSeed = (uint64_t)time(0) * 1000003ULL + (uint64_t)getpid();
+	return rngSeed;
+}
+
+#endif /* UTILS_RNG_HPP_ */
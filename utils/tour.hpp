@@ -0,0 +1,397 @@
+#ifndef UTILS_TOUR_HPP_
+#define UTILS_TOUR_HPP_
+
+/*
+	Tour representations with a common interface
+
+	  init(order, n)     build from a permutation of 0..n-1
+	  toArray(order)     write the tour back, starting at city 0
+	  next(c), prev(c)   neighbors of city c in the current orientation
+	  between(a, b, c)   true if b lies on the path a -> c
+	  flip(b, c)         reverse the path b -> c: the edges (prev(b), b)
+	                     and (c, next(c)) become (prev(b), c) and (b, next(c))
+
+	A flip may reverse the complementary path instead (the cycle is the
+	same), so the orientation is not stable across flips. Moves built
+	from several flips should go through make2opt(), which looks at the
+	current orientation.
+
+	ArrayTour: the plain int array plus a city -> position index,
+	           flips move at most N/2 cities.
+	TwoLevelTour: two-level doubly-linked list (as in LKH): the tour is
+	           cut into about sqrt(N) segments, each with a reversal bit,
+	           so a flip splits at most two segments and reverses a run
+	           of whole segments, O(sqrt(N)).
+
+	Selected with --tour=array|twolevel.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+enum TourMode { TOUR_ARRAY = 0, TOUR_TWOLEVEL };
+
+int parseTourMode(const char *name) {
+	if (name == NULL || strcmp(name, "array") == 0)
+		return TOUR_ARRAY;
+	if (strcmp(name, "twolevel") == 0)
+		return TOUR_TWOLEVEL;
+	fprintf(stderr, "Unknown tour representation: %s (array|twolevel)\n", name);
+	exit(1);
+}
+
+class ArrayTour {
+	public:
+		void init(const int *order, int _n) {
+			n = _n;
+			tour.assign(order, order + n);
+			pos.resize(n);
+			for (int i = 0; i < n; ++i)
+				pos[tour[i]] = i;
+		}
+
+		void toArray(int *order) const {
+			int st = pos[0];
+			for (int i = 0; i < n; ++i)
+				order[i] = tour[(st + i) % n];
+		}
+
+		inline int next(int c) const {
+			int i = pos[c] + 1;
+			return tour[i == n ? 0 : i];
+		}
+
+		inline int prev(int c) const {
+			int i = pos[c];
+			return tour[i == 0 ? n - 1 : i - 1];
+		}
+
+		inline bool between(int a, int b, int c) const {
+			int pa = pos[a], pb = pos[b], pc = pos[c];
+			if (pa <= pc)
+				return pa <= pb && pb <= pc;
+			return pb >= pa || pb <= pc;
+		}
+
+		/* reverses whichever of b..c and its complement is shorter */
+		void flip(int b, int c) {
+			int i = pos[b], j = pos[c];
+			int len = (j - i + n) % n + 1;
+			if (2 * len > n) {
+				i = (j + 1 == n) ? 0 : j + 1;
+				j = (pos[b] == 0) ? n - 1 : pos[b] - 1;
+				len = n - len;
+			}
+			for (int k = 0; k < len / 2; ++k) {
+				int x = tour[i], y = tour[j];
+				tour[i] = y;
+				pos[y] = i;
+				tour[j] = x;
+				pos[x] = j;
+				i = (i + 1 == n) ? 0 : i + 1;
+				j = (j == 0) ? n - 1 : j - 1;
+			}
+		}
+
+	private:
+		int n;
+		std::vector<int> tour;		// position -> city
+		std::vector<int> pos;		// city -> position
+};
+
+class TwoLevelTour {
+	public:
+		void init(const int *order, int _n) {
+			n = _n;
+			groupSize = (int)sqrt((double)n);
+			if (groupSize < 4)
+				groupSize = 4;
+			nseg = (n + groupSize - 1) / groupSize;
+			if (nseg < 2) {
+				nseg = 2;
+				groupSize = (n + 1) / 2;
+			}
+			suc.resize(n);
+			pred.resize(n);
+			seq.resize(n);
+			seg.resize(n);
+			first.resize(nseg);
+			last.resize(nseg);
+			segNext.resize(nseg);
+			segPrev.resize(nseg);
+			rank.resize(nseg);
+			size.resize(nseg);
+			rev.resize(nseg);
+			runBuf.resize(nseg);
+			rankBuf.resize(nseg);
+			for (int s = 0; s < nseg; ++s) {
+				int st = s * n / nseg, ed = (s + 1) * n / nseg;		// [st, ed)
+				first[s] = order[st];
+				last[s] = order[ed - 1];
+				size[s] = ed - st;
+				rev[s] = 0;
+				rank[s] = s;
+				segNext[s] = (s + 1) % nseg;
+				segPrev[s] = (s - 1 + nseg) % nseg;
+				for (int i = st; i < ed; ++i) {
+					int c = order[i];
+					seg[c] = s;
+					seq[c] = i - st;
+					if (i > st)
+						pred[c] = order[i - 1];
+					if (i + 1 < ed)
+						suc[c] = order[i + 1];
+				}
+			}
+			unbalanced = false;
+		}
+
+		void toArray(int *order) const {
+			int c = 0;
+			for (int i = 0; i < n; ++i) {
+				order[i] = c;
+				c = next(c);
+			}
+		}
+
+		inline int next(int c) const {
+			int s = seg[c];
+			if (rev[s])
+				return c == first[s] ? head(segNext[s]) : pred[c];
+			return c == last[s] ? head(segNext[s]) : suc[c];
+		}
+
+		inline int prev(int c) const {
+			int s = seg[c];
+			if (rev[s])
+				return c == last[s] ? tail(segPrev[s]) : suc[c];
+			return c == first[s] ? tail(segPrev[s]) : pred[c];
+		}
+
+		bool between(int a, int b, int c) const {
+			if (!before(c, a))
+				return !before(b, a) && !before(c, b);
+			return !before(b, a) || !before(c, b);
+		}
+
+		void flip(int b, int c) {
+			if (b == c)
+				return;
+			int a = prev(b), d = next(c);
+			if (d == b)
+				return;		// the whole cycle, nothing changes
+			if (seg[b] == seg[c] && ord(b) <= ord(c)) {
+				reverseInside(b, c);
+				return;
+			}
+			if (seg[a] == seg[d] && ord(d) <= ord(a)) {
+				reverseInside(d, a);
+				return;
+			}
+			splitBefore(b);
+			if (seg[b] == seg[c] && ord(b) <= ord(c)) {
+				reverseInside(b, c);
+				rebalance();
+				return;
+			}
+			if (seg[a] == seg[d] && ord(d) <= ord(a)) {
+				reverseInside(d, a);
+				rebalance();
+				return;
+			}
+			splitBefore(d);
+			/* now b and d are segment heads: b..c and d..a are runs of whole segments */
+			int k = (rank[seg[c]] - rank[seg[b]] + nseg) % nseg + 1;
+			if (k <= nseg - k)
+				reverseSegments(seg[b], k);
+			else
+				reverseSegments(seg[d], nseg - k);
+			rebalance();
+		}
+
+	private:
+		int n, nseg, groupSize;
+		/* per city, in the forward orientation of its segment */
+		std::vector<int> suc, pred, seq, seg;
+		/* per segment */
+		std::vector<int> first, last, segNext, segPrev, rank, size;
+		std::vector<char> rev;
+		std::vector<int> runBuf, rankBuf;
+		bool unbalanced;
+
+		inline int head(int s) const {
+			return rev[s] ? last[s] : first[s];
+		}
+
+		inline int tail(int s) const {
+			return rev[s] ? first[s] : last[s];
+		}
+
+		/* position of c inside its segment, in traversal order */
+		inline int ord(int c) const {
+			return rev[seg[c]] ? -seq[c] : seq[c];
+		}
+
+		/* x comes strictly before y, counting from the segment with rank 0 */
+		inline bool before(int x, int y) const {
+			int rx = rank[seg[x]], ry = rank[seg[y]];
+			if (rx != ry)
+				return rx < ry;
+			return ord(x) < ord(y);
+		}
+
+		/* reverse b..c, both in the same segment and b not after c */
+		void reverseInside(int b, int c) {
+			int s = seg[b];
+			int u = rev[s] ? c : b, w = rev[s] ? b : c;		// forward u..w
+			int pu = (u == first[s]) ? -1 : pred[u];
+			int nw = (w == last[s]) ? -1 : suc[w];
+			int lo = seq[u], hi = seq[w];
+			int x = u;
+			while (true) {
+				int nx = suc[x];
+				int tmp = suc[x];
+				suc[x] = pred[x];
+				pred[x] = tmp;
+				seq[x] = lo + hi - seq[x];
+				if (x == w)
+					break;
+				x = nx;
+			}
+			if (pu < 0)
+				first[s] = w;
+			else
+				suc[pu] = w;
+			pred[w] = pu;
+			if (nw < 0)
+				last[s] = u;
+			else
+				pred[nw] = u;
+			suc[u] = nw;
+		}
+
+		/* move the traversal head of s to the traversal tail of t */
+		void moveHeadToTail(int s, int t) {
+			int x;
+			if (rev[s]) {
+				x = last[s];
+				last[s] = pred[x];
+			}
+			else {
+				x = first[s];
+				first[s] = suc[x];
+			}
+			if (rev[t]) {
+				pred[first[t]] = x;
+				suc[x] = first[t];
+				seq[x] = seq[first[t]] - 1;
+				first[t] = x;
+			}
+			else {
+				suc[last[t]] = x;
+				pred[x] = last[t];
+				seq[x] = seq[last[t]] + 1;
+				last[t] = x;
+			}
+			seg[x] = t;
+			size[s]--;
+			size[t]++;
+		}
+
+		/* move the traversal tail of s to the traversal head of t */
+		void moveTailToHead(int s, int t) {
+			int x;
+			if (rev[s]) {
+				x = first[s];
+				first[s] = suc[x];
+			}
+			else {
+				x = last[s];
+				last[s] = pred[x];
+			}
+			if (rev[t]) {
+				suc[last[t]] = x;
+				pred[x] = last[t];
+				seq[x] = seq[last[t]] + 1;
+				last[t] = x;
+			}
+			else {
+				pred[first[t]] = x;
+				suc[x] = first[t];
+				seq[x] = seq[first[t]] - 1;
+				first[t] = x;
+			}
+			seg[x] = t;
+			size[s]--;
+			size[t]++;
+		}
+
+		/* make x the head of a segment by moving the smaller part of its segment to a neighbor */
+		void splitBefore(int x) {
+			int s = seg[x];
+			if (x == head(s))
+				return;
+			int cnt = abs(seq[x] - seq[head(s)]);		// cities before x
+			int t;
+			if (cnt <= size[s] - cnt) {
+				t = segPrev[s];
+				while (head(s) != x)
+					moveHeadToTail(s, t);
+			}
+			else {
+				t = segNext[s];
+				while (seg[x] == s)
+					moveTailToHead(s, t);
+			}
+			/* keep the segments short and the sequence numbers far from overflow */
+			if (size[t] > 4 * groupSize || abs(seq[first[t]]) > (1 << 30) || abs(seq[last[t]]) > (1 << 30))
+				unbalanced = true;
+		}
+
+		/* reverse the order of the k segments starting at s */
+		void reverseSegments(int s, int k) {
+			int P = segPrev[s];
+			for (int i = 0; i < k; ++i) {
+				runBuf[i] = s;
+				rankBuf[i] = rank[s];
+				s = segNext[s];
+			}
+			int Q = s;
+			for (int i = 0; i < k; ++i) {
+				int t = runBuf[k - 1 - i];
+				rank[t] = rankBuf[i];
+				rev[t] ^= 1;
+				segNext[t] = (i + 1 < k) ? runBuf[k - 2 - i] : Q;
+				segPrev[t] = (i > 0) ? runBuf[k - i] : P;
+			}
+			segNext[P] = runBuf[k - 1];
+			segPrev[Q] = runBuf[0];
+		}
+
+		/* rebuild evenly sized segments once a split made one too large */
+		void rebalance() {
+			if (!unbalanced)
+				return;
+			std::vector<int> order(n);
+			toArray(&order[0]);
+			init(&order[0], n);
+		}
+};
+
+/*
+	2-opt on the cycle: the edges (a, b) and (c, d) become (a, c) and
+	(b, d). Either b = next(a) and d = next(c), or b = prev(a) and
+	d = prev(c).
+*/
+template<class TourT>
+inline void make2opt(TourT &t, int a, int b, int c, int d) {
+	if (t.next(a) == b)
+		t.flip(b, c);
+	else
+		t.flip(a, d);
+}
+
+#endif /* UTILS_TOUR_HPP_ */
@@ -0,0 +1,382 @@
+#ifndef UTILS_TSPLIB_HPP_
+#define UTILS_TSPLIB_HPP_
+
+/*
+	Shared TSPLIB instance loader
+
+	The file is mapped read-only with mmap() and scanned once. Header
+	keywords ("NAME: x" as well as "NAME : x") may appear in any order,
+	COMMENT may be repeated, and the data sections are decoded with a
+	small hand-rolled number parser instead of fscanf. Everything is sized
+	from DIMENSION at runtime, there is no MAXN limit.
+
+	Supported: EDGE_WEIGHT_TYPE EUC_2D and EXPLICIT with the
+	FULL_MATRIX / UPPER_ROW / LOWER_ROW / UPPER_DIAG_ROW / LOWER_DIAG_ROW
+	formats. City i of the file is stored as index (i-1).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum EdgeWeightType { WEIGHT_UNKNOWN = 0, WEIGHT_EUC_2D, WEIGHT_EXPLICIT };
+enum EdgeWeightFormat { FORMAT_NONE = 0, FORMAT_FULL_MATRIX, FORMAT_UPPER_ROW,
+	FORMAT_LOWER_ROW, FORMAT_UPPER_DIAG_ROW, FORMAT_LOWER_DIAG_ROW };
+
+struct TSPInstance {
+	char name[128];
+	char comment[256];
+	char weightTypeName[32];
+	int n;					// DIMENSION
+	int weightType;			// EdgeWeightType
+	int weightFormat;		// EdgeWeightFormat, EXPLICIT only
+	float *coordX;			// NODE_COORD_SECTION, n entries (NULL if absent)
+	float *coordY;
+	float *weights;			// EXPLICIT: full symmetric n*n matrix (NULL otherwise)
+};
+
+/* cursor over the mapped file, [cur, end) */
+struct TSPScanner {
+	const char *cur;
+	const char *end;
+};
+
+inline bool tspIsSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline void tspSkipSpace(TSPScanner &sc) {
+	while (sc.cur < sc.end && tspIsSpace(*sc.cur))
+		++sc.cur;
+}
+
+inline void tspSkipBlank(TSPScanner &sc) {
+	while (sc.cur < sc.end && (*sc.cur == ' ' || *sc.cur == '\t'))
+		++sc.cur;
+}
+
+/* bounded copy of a header value */
+inline void tspCopy(char *dst, int size, const char *src) {
+	int len = strlen(src);
+	if (len > size - 1)
+		len = size - 1;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+/* copy the rest of the current line (trimmed) into buff and move to the next line */
+void tspReadLine(TSPScanner &sc, char *buff, int size) {
+	tspSkipBlank(sc);
+	const char *st = sc.cur;
+	while (sc.cur < sc.end && *sc.cur != '\n')
+		++sc.cur;
+	const char *ed = sc.cur;
+	while (ed > st && tspIsSpace(ed[-1]))
+		--ed;
+	int len = ed - st;
+	if (len > size - 1)
+		len = size - 1;
+	memcpy(buff, st, len);
+	buff[len] = '\0';
+	if (sc.cur < sc.end)
+		++sc.cur;
+}
+
+/* read a keyword, up to the next blank or colon */
+bool tspReadKeyword(TSPScanner &sc, char *buff, int size) {
+	tspSkipSpace(sc);
+	int len = 0;
+	while (sc.cur < sc.end && !tspIsSpace(*sc.cur) && *sc.cur != ':') {
+		if (len < size - 1)
+			buff[len++] = *sc.cur;
+		++sc.cur;
+	}
+	buff[len] = '\0';
+	return len > 0;
+}
+
+/* hand-rolled decimal parser: [+-]digits[.digits][(e|E)[+-]digits] */
+bool tspReadNumber(TSPScanner &sc, double &value) {
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+		1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+	tspSkipSpace(sc);
+	const char *p = sc.cur, *end = sc.end;
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		++p;
+	}
+	unsigned long long mant = 0;
+	int digits = 0, scale = 0;
+	const char *st = p;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+		if (digits < 18) {
+			mant = mant * 10 + (*p - '0');
+			if (mant)
+				++digits;
+		}
+		else
+			++scale;
+	}
+	if (p < end && *p == '.') {
+		++p;
+		for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+			if (digits < 18) {
+				mant = mant * 10 + (*p - '0');
+				if (mant)
+					++digits;
+				--scale;
+			}
+		}
+	}
+	if (p == st || (p == st + 1 && *st == '.'))
+		return false;
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool eneg = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			eneg = (*q == '-');
+			++q;
+		}
+		if (q < end && *q >= '0' && *q <= '9') {
+			int e = 0;
+			for (; q < end && *q >= '0' && *q <= '9'; ++q)
+				if (e < 1000)
+					e = e * 10 + (*q - '0');
+			scale += eneg ? -e : e;
+			p = q;
+		}
+	}
+	double v = (double)mant;
+	if (scale < 0)
+		v = (scale >= -18) ? v / pow10[-scale] : v * pow(10.0, scale);
+	else if (scale > 0)
+		v = (scale <= 18) ? v * pow10[scale] : v * pow(10.0, scale);
+	value = neg ? -v : v;
+	sc.cur = p;
+	return true;
+}
+
+void tspFail(const char *filename, const char *msg) {
+	fprintf(stderr, "%s: %s\n", filename, msg);
+	exit(1);
+}
+
+/* NODE_COORD_SECTION: "id x y" per city */
+void tspReadCoords(TSPScanner &sc, TSPInstance &inst, const char *filename) {
+	double id, xx, yy;
+	for (int i = 0; i < inst.n; ++i) {
+		if (!tspReadNumber(sc, id) || !tspReadNumber(sc, xx) || !tspReadNumber(sc, yy))
+			tspFail(filename, "truncated NODE_COORD_SECTION");
+		int k = (int)id - 1;
+		if (k < 0 || k >= inst.n)
+			tspFail(filename, "node id out of range in NODE_COORD_SECTION");
+		inst.coordX[k] = (float)xx;
+		inst.coordY[k] = (float)yy;
+	}
+}
+
+/* EDGE_WEIGHT_SECTION, expanded to a full symmetric matrix */
+void tspReadWeights(TSPScanner &sc, TSPInstance &inst, const char *filename) {
+	int n = inst.n;
+	float *w = inst.weights;
+	double v;
+	for (int i = 0; i < n; ++i) {
+		int from = 0, to = 0;
+		switch (inst.weightFormat) {
+			case FORMAT_FULL_MATRIX:    from = 0;     to = n;     break;
+			case FORMAT_UPPER_ROW:      from = i + 1; to = n;     break;
+			case FORMAT_UPPER_DIAG_ROW: from = i;     to = n;     break;
+			case FORMAT_LOWER_ROW:      from = 0;     to = i;     break;
+			case FORMAT_LOWER_DIAG_ROW: from = 0;     to = i + 1; break;
+			default: tspFail(filename, "unsupported EDGE_WEIGHT_FORMAT");
+		}
+		for (int j = from; j < to; ++j) {
+			if (!tspReadNumber(sc, v))
+				tspFail(filename, "truncated EDGE_WEIGHT_SECTION");
+			w[(size_t)i * n + j] = (float)v;
+			if (inst.weightFormat != FORMAT_FULL_MATRIX)
+				w[(size_t)j * n + i] = (float)v;
+		}
+	}
+}
+
+/* load a TSPLIB file into inst, exits on malformed input */
+void loadTSPLIB(const char *filename, TSPInstance &inst) {
+	memset(&inst, 0, sizeof(inst));
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("Cannot open the file!\n");
+		exit(1);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		tspFail(filename, "empty file");
+	}
+	size_t size = st.st_size;
+	char *data = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		tspFail(filename, "mmap() failed");
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	TSPScanner sc = { data, data + size };
+	char key[64], value[256];
+	while (tspReadKeyword(sc, key, sizeof(key))) {
+		if (strcmp(key, "EOF") == 0)
+			break;
+		if (strcmp(key, "NODE_COORD_SECTION") == 0) {
+			if (inst.n <= 0)
+				tspFail(filename, "NODE_COORD_SECTION before DIMENSION");
+			inst.coordX = (float *)malloc(sizeof(float) * inst.n);
+			inst.coordY = (float *)malloc(sizeof(float) * inst.n);
+			tspReadCoords(sc, inst, filename);
+			continue;
+		}
+		if (strcmp(key, "EDGE_WEIGHT_SECTION") == 0) {
+			if (inst.n <= 0)
+				tspFail(filename, "EDGE_WEIGHT_SECTION before DIMENSION");
+			inst.weights = (float *)calloc((size_t)inst.n * inst.n, sizeof(float));
+			if (inst.weights == NULL)
+				tspFail(filename, "cannot allocate the weight matrix");
+			tspReadWeights(sc, inst, filename);
+			continue;
+		}
+		if (strcmp(key, "DISPLAY_DATA_SECTION") == 0) {
+			double skip;
+			for (int i = 0; i < 3 * inst.n; ++i)
+				tspReadNumber(sc, skip);
+			continue;
+		}
+		/* "KEY: value" or "KEY : value" */
+		tspSkipBlank(sc);
+		if (sc.cur < sc.end && *sc.cur == ':')
+			++sc.cur;
+		tspReadLine(sc, value, sizeof(value));
+		if (strcmp(key, "NAME") == 0) {
+			tspCopy(inst.name, sizeof(inst.name), value);
+		}
+		else if (strcmp(key, "COMMENT") == 0) {
+			if (inst.comment[0] == '\0')
+				tspCopy(inst.comment, sizeof(inst.comment), value);
+		}
+		else if (strcmp(key, "TYPE") == 0) {
+			if (strncmp(value, "TSP", 3) != 0)
+				tspFail(filename, "only symmetric TSP instances are supported");
+		}
+		else if (strcmp(key, "DIMENSION") == 0) {
+			inst.n = atoi(value);
+			if (inst.n <= 2)
+				tspFail(filename, "DIMENSION must be at least 3");
+		}
+		else if (strcmp(key, "EDGE_WEIGHT_TYPE") == 0) {
+			tspCopy(inst.weightTypeName, sizeof(inst.weightTypeName), value);
+			if (strcmp(value, "EUC_2D") == 0)
+				inst.weightType = WEIGHT_EUC_2D;
+			else if (strcmp(value, "EXPLICIT") == 0)
+				inst.weightType = WEIGHT_EXPLICIT;
+			else
+				tspFail(filename, "unsupported EDGE_WEIGHT_TYPE");
+		}
+		else if (strcmp(key, "EDGE_WEIGHT_FORMAT") == 0) {
+			if (strcmp(value, "FULL_MATRIX") == 0)
+				inst.weightFormat = FORMAT_FULL_MATRIX;
+			else if (strcmp(value, "UPPER_ROW") == 0)
+				inst.weightFormat = FORMAT_UPPER_ROW;
+			else if (strcmp(value, "LOWER_ROW") == 0)
+				inst.weightFormat = FORMAT_LOWER_ROW;
+			else if (strcmp(value, "UPPER_DIAG_ROW") == 0)
+				inst.weightFormat = FORMAT_UPPER_DIAG_ROW;
+			else if (strcmp(value, "LOWER_DIAG_ROW") == 0)
+				inst.weightFormat = FORMAT_LOWER_DIAG_ROW;
+			else
+				tspFail(filename, "unsupported EDGE_WEIGHT_FORMAT");
+		}
+		/* other keywords (DISPLAY_DATA_TYPE, NODE_COORD_TYPE, ...) are ignored */
+	}
+	munmap(data, size);
+
+	if (inst.n <= 0)
+		tspFail(filename, "missing DIMENSION");
+	if (inst.weightType == WEIGHT_EUC_2D && inst.coordX == NULL)
+		tspFail(filename, "missing NODE_COORD_SECTION");
+	if (inst.weightType == WEIGHT_EXPLICIT && inst.weights == NULL)
+		tspFail(filename, "missing EDGE_WEIGHT_SECTION");
+	if (inst.weightType == WEIGHT_UNKNOWN)
+		tspFail(filename, "missing EDGE_WEIGHT_TYPE");
+}
+
+/* print the header the same way the old per-binary loaders did */
+void printInstance(const TSPInstance &inst) {
+	printf("%s\n", inst.name);
+	printf("%s\n", inst.comment);
+	printf("The N is: %d\n", inst.n);
+	printf("the type is: %s\n", inst.weightTypeName);
+}
+
+/* EUC_2D distance between city i and j, unrounded */
+inline float eucDist(const float *x, const float *y, int i, int j) {
+	float dx = x[i] - x[j], dy = y[i] - y[j];
+	return sqrtf(dx * dx + dy * dy);
+}
+
+/* position of (i, j) in the packed lower triangle (diagonal included), either order */
+inline size_t triIndex(int i, int j) {
+	size_t hi = (i > j) ? i : j;	// cmov, no branch
+	size_t lo = (size_t)i + j - hi;
+	return hi * (hi + 1) / 2 + lo;
+}
+
+/*
+	distance matrix, (i-1) instead of i: the full n*n matrix, row-major,
+	or with packed only the lower triangle in triIndex() order, n*(n+1)/2
+	entries. Every supported instance type is symmetric.
+*/
+float *buildDistMatrix(const TSPInstance &inst, bool packed = false) {
+	int n = inst.n;
+	size_t cnt = packed ? (size_t)n * (n + 1) / 2 : (size_t)n * n;
+	float *d = (float *)malloc(sizeof(float) * cnt);
+	if (d == NULL) {
+		fprintf(stderr, "Cannot allocate the %d x %d distance matrix!\n", n, n);
+		exit(1);
+	}
+	if (inst.weightType == WEIGHT_EXPLICIT && !packed) {
+		memcpy(d, inst.weights, sizeof(float) * cnt);
+		return d;
+	}
+	if (inst.weightType == WEIGHT_EXPLICIT) {
+		for (int i = 0; i < n; ++i) {
+			for (int j = 0; j <= i; ++j)
+				d[triIndex(i, j)] = inst.weights[(size_t)i * n + j];
+		}
+		return d;
+	}
+	for (int i = 0; i < n; ++i) {
+		if (packed) {
+			for (int j = 0; j <= i; ++j)
+				d[triIndex(i, j)] = eucDist(inst.coordX, inst.coordY, i, j);
+			continue;
+		}
+		d[(size_t)i * n + i] = 0;
+		for (int j = i + 1; j < n; ++j) {
+			d[(size_t)i * n + j] = eucDist(inst.coordX, inst.coordY, i, j);
+			d[(size_t)j * n + i] = d[(size_t)i * n + j];
+		}
+	}
+	return d;
+}
+
+void freeInstance(TSPInstance &inst) {
+	free(inst.coordX);
+	free(inst.coordY);
+	free(inst.weights);
+	inst.coordX = inst.coordY = inst.weights = NULL;
+}
+
+#endif /* UTILS_TSPLIB_HPP_ */